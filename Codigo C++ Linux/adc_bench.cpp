@@ -0,0 +1,121 @@
+// adc_bench - packs known sample sequences with adc_pack.c of Pc-pic (run
+// on the host through ccs2host.awk) in each encoding, the way
+// EnviaMuestrasADC() does, and decodes the packets back with adc_pack.h,
+// the decoder of adc_decode.  Reports packets and samples per packet; the
+// exit status is 1 if a sample does not come back as it went in.
+//
+//   adc_bench
+//
+// A sample adc_pack_put() refuses ends the packet and starts the next one,
+// as it would on the board after usb_put_packet().  The sequences cover
+// the edges of each encoding: deltas of -128 and 127 (DELTA8) and -8 and 7
+// (DELTA4), the ones just outside them, both ends of the 10 bit range and
+// a RAW10 group cut short by the end of a packet.
+#include "adc_pack.h"
+#include "ccs_host.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fw {
+#define ADC_PACK_SIZE 32             // USB_EP1_TX_SIZE of pc_usb.c
+#include "adc_pack_host.h"
+}
+
+namespace {
+
+struct Sequence {
+    const char* name;
+    std::vector<uint16_t> s;
+};
+
+std::vector<Sequence> sequences()
+{
+    std::vector<Sequence> v;
+    Sequence ramp{"ramp", {}};
+    for (unsigned i = 0; i < 300; ++i)
+        ramp.s.push_back(static_cast<uint16_t>(i * 3 % 1024));
+    v.push_back(ramp);
+
+    Sequence edges{"edges", {512}};
+    for (int d : {127, -128, 7, -8, 128, -129, 8, -9, 0, 1, -1, 127, 127, -128, -128})
+        edges.s.push_back(static_cast<uint16_t>(edges.s.back() + d));
+    v.push_back(edges);
+
+    Sequence ends{"ends", {}};
+    for (unsigned i = 0; i < 60; ++i)
+        ends.s.push_back(i & 1 ? 1023 : 0);
+    v.push_back(ends);
+
+    Sequence noise{"noise", {}};
+    std::mt19937 rng(42);
+    int x = 512;
+    for (unsigned i = 0; i < 2000; ++i) {
+        x += static_cast<int>(rng() % 21) - 10;      // mostly DELTA4 with DELTA8 steps
+        if (i % 97 == 0)
+            x += static_cast<int>(rng() % 301) - 150;
+        x = x < 0 ? 0 : x > 1023 ? 1023 : x;
+        noise.s.push_back(static_cast<uint16_t>(x));
+    }
+    v.push_back(noise);
+
+    Sequence flat{"flat", std::vector<uint16_t>(200, 700)};
+    v.push_back(flat);
+    return v;
+}
+
+struct Result {
+    unsigned packets = 0;
+    std::string why;
+};
+
+Result run(const Sequence& q, uint8_t enc)
+{
+    Result r;
+    std::vector<uint16_t> back;
+    const auto send = [&] {
+        uint16_t out[256];
+        const int n = picusb::decode_adc_packet(fw::adc_pack_buf, fw::adc_pack_len(), out, 256);
+        if (n < 0) {
+            r.why = "packet " + std::to_string(r.packets) + " does not decode";
+            return;
+        }
+        back.insert(back.end(), out, out + n);
+        ++r.packets;
+    };
+    fw::adc_pack_begin(enc, q.s[0]);
+    for (size_t i = 1; i < q.s.size() && r.why.empty(); ++i)
+        if (!fw::adc_pack_put(q.s[i])) {
+            send();
+            fw::adc_pack_begin(enc, q.s[i]);
+        }
+    if (r.why.empty())
+        send();
+    if (r.why.empty() && back != q.s) {
+        size_t i = 0;
+        while (i < back.size() && i < q.s.size() && back[i] == q.s[i])
+            ++i;
+        r.why = "sample " + std::to_string(i) + " differs";
+    }
+    return r;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-8s %-7s %7s %7s %8s\n", "samples", "enc", "count", "packets", "/packet");
+    const char* names[] = {"raw10", "delta8", "delta4"};
+    bool ok = true;
+    for (const Sequence& q : sequences())
+        for (uint8_t enc : {ADC_PACK_RAW10, ADC_PACK_DELTA8, ADC_PACK_DELTA4}) {
+            const Result r = run(q, enc);
+            std::printf("%-8s %-7s %7zu %7u %8.1f  %s\n", q.name, names[enc], q.s.size(),
+                        r.packets, r.packets ? double(q.s.size()) / r.packets : 0.0,
+                        r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+            ok = ok && r.why.empty();
+        }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+// adc_decode - turns a capture of EP1 IN ADC packets into one sample per line.
+//
+//   adc_decode [capture.bin]      (reads stdin when no file is given)
+//
+// The capture is the raw concatenation of packets as returned by the device
+// for the TIPO_ADC (89) command.  Packet boundaries are recovered from the
+// header, so short packets need no padding.
+#include "adc_pack.h"
+
+#include <cstdio>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    FILE* in = stdin;
+    if (argc > 1 && !(in = std::fopen(argv[1], "rb"))) {
+        std::perror(argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof chunk, in)) > 0)
+        data.insert(data.end(), chunk, chunk + got);
+
+    uint16_t samples[256];
+    size_t pos = 0, packets = 0, total = 0;
+    while (pos < data.size()) {
+        picusb::AdcPacketHeader h;
+        if (!picusb::adc_pack_header(&data[pos], data.size() - pos, h)) {
+            std::fprintf(stderr, "adc_decode: bad packet at offset %zu\n", pos);
+            return 1;
+        }
+        const int n = picusb::decode_adc_packet(&data[pos], data.size() - pos, samples, 256);
+        for (int i = 0; i < n; ++i)
+            std::printf("%u\n", samples[i]);
+        pos += picusb::kAdcPackHeader + picusb::adc_pack_payload_len(h.encoding, h.count);
+        ++packets;
+        total += static_cast<size_t>(n);
+    }
+    std::fprintf(stderr, "adc_decode: %zu packets, %zu samples\n", packets, total);
+    return 0;
+}
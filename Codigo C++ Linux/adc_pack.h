@@ -0,0 +1,106 @@
+// adc_pack.h - host decoder for the compact ADC packet format.
+//
+// Mirrors "Codigo C/Pc-pic/adc_pack.c"; see the header of that file for the
+// packet layout.  Decoding is table free and branch light: RAW10 works on
+// whole 5 byte groups and the delta encodings undo zig-zag with one xor.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace picusb {
+
+enum class AdcEncoding : uint8_t { Raw10 = 0, Delta8 = 1, Delta4 = 2 };
+
+constexpr uint8_t kAdcPackMagic = 0xA0;
+constexpr size_t kAdcPackHeader = 4;
+
+struct AdcPacketHeader {
+    AdcEncoding encoding;
+    uint8_t count;      // samples in the packet, including the first one
+    uint16_t first;
+};
+
+// Payload bytes that follow the header for `count` samples.
+constexpr size_t adc_pack_payload_len(AdcEncoding enc, uint8_t count)
+{
+    const size_t n = count ? count - 1u : 0u;
+    switch (enc) {
+    case AdcEncoding::Raw10: return n + (n + 3) / 4;
+    case AdcEncoding::Delta8: return n;
+    case AdcEncoding::Delta4: return (n + 1) / 2;
+    }
+    return 0;
+}
+
+// Parses and validates the 4 byte header.  Returns false for anything that
+// is not an ADC packet.
+inline bool adc_pack_header(const uint8_t* p, size_t len, AdcPacketHeader& h)
+{
+    if (len < kAdcPackHeader || (p[0] & 0xF0) != kAdcPackMagic)
+        return false;
+    const uint8_t enc = p[0] & 0x0F;
+    if (enc > static_cast<uint8_t>(AdcEncoding::Delta4) || p[1] == 0)
+        return false;
+    h.encoding = static_cast<AdcEncoding>(enc);
+    h.count = p[1];
+    h.first = static_cast<uint16_t>(p[2] | (p[3] << 8));
+    return len >= kAdcPackHeader + adc_pack_payload_len(h.encoding, h.count);
+}
+
+inline int zigzag_decode(unsigned z)
+{
+    return static_cast<int>(z >> 1) ^ -static_cast<int>(z & 1);
+}
+
+// Decodes one packet into out[].  Returns the number of samples written, or
+// -1 if the packet is malformed or out[] is too small.
+inline int decode_adc_packet(const uint8_t* p, size_t len, uint16_t* out, size_t cap)
+{
+    AdcPacketHeader h;
+    if (!adc_pack_header(p, len, h) || cap < h.count)
+        return -1;
+
+    const uint8_t* q = p + kAdcPackHeader;
+    size_t n = h.count - 1u;
+    uint16_t* o = out;
+    *o++ = h.first;
+
+    switch (h.encoding) {
+    case AdcEncoding::Raw10:
+        while (n >= 4) {
+            const unsigned hi = q[0];
+            o[0] = static_cast<uint16_t>(q[1] | ((hi & 0x03) << 8));
+            o[1] = static_cast<uint16_t>(q[2] | ((hi & 0x0C) << 6));
+            o[2] = static_cast<uint16_t>(q[3] | ((hi & 0x30) << 4));
+            o[3] = static_cast<uint16_t>(q[4] | ((hi & 0xC0) << 2));
+            q += 5;
+            o += 4;
+            n -= 4;
+        }
+        for (size_t k = 0; k < n; ++k)
+            o[k] = static_cast<uint16_t>(q[1 + k] | (((q[0] >> (2 * k)) & 3) << 8));
+        break;
+
+    case AdcEncoding::Delta8: {
+        int prev = h.first;
+        for (size_t k = 0; k < n; ++k) {
+            prev += zigzag_decode(q[k]);
+            o[k] = static_cast<uint16_t>(prev);
+        }
+        break;
+    }
+
+    case AdcEncoding::Delta4: {
+        int prev = h.first;
+        for (size_t k = 0; k < n; ++k) {
+            prev += zigzag_decode((q[k >> 1] >> ((k & 1) * 4)) & 0x0F);
+            o[k] = static_cast<uint16_t>(prev);
+        }
+        break;
+    }
+    }
+    return h.count;
+}
+
+} // namespace picusb
@@ -0,0 +1,366 @@
+// bridge_bench - runs the USB to UART bridge of Pc-pic (usb_uart.c with
+// uart_tx.c, uart_rx.c and uart_baud.h) on an emulated PIC between a
+// model of the PC's USB host controller (usb_sie.h) and a second emulated
+// PIC on the serial side (the uart_tx.c and uart_rx.c of serial_bench),
+// joined by a pseudo-terminal pair through the EUSART model of eusart.h.
+// Reports the throughput of each direction and the latency each hop adds;
+// the exit status is 1 if a byte is lost or wrong.
+//
+//   bridge_bench
+//
+// Down is PC -> Pc-pic -> PIC B, up is PIC B -> Pc-pic -> PC; both run at
+// once in the full duplex rows.  The PC writes transfers of a message size
+// (max: always one waiting); PIC B queues its messages with uart_tx_write()
+// from its main loop and takes every byte uart_rx.c has.  Main loop passes
+// cost 100 instruction cycles, interrupts and register accesses come on top
+// as in serial_bench.
+//
+// Hops, each an average and a maximum per byte:
+//   usb out    PC write -> the OUT packet is in the Pc-pic buffer (includes
+//              the NAKs while the UART queue has no room)
+//   uart down  -> PIC B took the byte from uart_rx.c
+//   uart up    PIC B queued the byte -> Pc-pic armed the IN packet holding
+//              it (UART time plus the wait for a full packet or the
+//              USB_UART_FLUSH_MS timeout)
+//   usb in     -> the IN packet reached the PC
+// Also: OUT packets NAKed for room, IN packets sent full and by timeout,
+// Pc-pic receive overruns, and the time Pc-pic spent in interrupts.
+#include "bridge_node.h"
+#include "ccs_host.h"
+#include "eusart.h"
+#include "serial_node.h"
+#include "usb_sie.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using picusb::BridgeCounters;
+using picusb::BridgeNode;
+using picusb::Eusart;
+using picusb::PtyLink;
+using picusb::SerialNode;
+using picusb::UsbSie;
+
+constexpr uint64_t kCycleNs = 4000000000ULL / HOST_CLOCK;
+constexpr uint64_t kLoopNs = 100 * kCycleNs;
+constexpr unsigned kWindowBytes = 2000;      // measured time, in byte times of the line
+constexpr unsigned kDrainBytes = 200;        // then the senders stop and the pipes empty
+constexpr uint64_t kDrainNs = 5000000;       // plus the flush timeout and the USB
+constexpr unsigned kBurst = 8;               // bytes PIC B queues per pass at max load
+
+struct Link {
+    BridgeNode bridge;
+    SerialNode tx, rx;
+};
+
+struct Case {
+    unsigned down;          // message size, 0: direction off
+    unsigned up;
+    unsigned load;          // percent of the line per direction, 0: max
+};
+
+struct Hop {
+    double sum = 0;
+    uint64_t max = 0;
+    unsigned n = 0;
+
+    void add(uint64_t ns)
+    {
+        sum += ns;
+        max = std::max(max, ns);
+        ++n;
+    }
+    double avg_us() const { return n ? sum / n / 1000.0 : 0.0; }
+    double max_us() const { return max / 1000.0; }
+};
+
+// One direction: byte i carries i & 0xFF; times per byte.
+struct Stream {
+    std::vector<uint64_t> queued, mid;
+    unsigned next = 0;      // index of the byte expected
+    unsigned received = 0, lost = 0, bad = 0;
+    uint64_t in_window = 0;
+    Hop first, second;
+
+    // Byte arriving at the far end; a little way ahead of the one expected
+    // means the ones in between were lost.
+    void arrive(uint8_t b, uint64_t mid_ns, uint64_t now, uint64_t window)
+    {
+        const unsigned ahead = static_cast<uint8_t>(b - next);
+        const unsigned i = next + ahead;
+        if (ahead >= 16 || i >= queued.size()) {
+            ++bad;
+            ++next;                 // it took the place of the one expected
+            return;
+        }
+        lost += ahead;
+        next = i + 1;
+        ++received;
+        if (now <= window)
+            ++in_window;
+        if (mid.size() <= i)
+            mid.resize(i + 1);
+        if (mid_ns)
+            mid[i] = mid_ns;
+        first.add(mid[i] - queued[i]);
+        second.add(now - mid[i]);
+    }
+};
+
+// Times at which messages of size bytes are due, every interval from 0
+// (interval 0: all at once), for as long as before window.
+struct Schedule {
+    unsigned size;
+    uint64_t interval;
+    uint64_t window;
+
+    bool on() const { return size != 0; }
+    uint64_t due(unsigned msg) const { return msg * interval; }
+    unsigned messages() const
+    {
+        return interval ? static_cast<unsigned>((window + interval - 1) / interval) : UINT32_MAX;
+    }
+};
+
+// The PC: OUT transfers from a Schedule, IN packets into a Stream.
+class Pc : public picusb::UsbHost {
+public:
+    Pc(const Schedule& s, Stream& down, Stream& up, uint64_t window)
+        : s_(s), down_(down), up_(up), window_(window) {}
+
+    unsigned out_data(uint64_t now, uint8_t* p, unsigned max) override
+    {
+        if (now >= window_ || out_next() > now) {
+            stopped_ = now >= window_;
+            return 0;
+        }
+        const unsigned i = static_cast<unsigned>(down_.queued.size());
+        const unsigned msg = s_.interval ? i / s_.size : 0;
+        const unsigned left = s_.interval ? s_.size - i % s_.size : UINT32_MAX;
+        const unsigned n = std::min(max, left);
+        const uint64_t land = now + UsbSie::transaction_ns(n);
+        for (unsigned k = 0; k < n; ++k) {
+            p[k] = static_cast<uint8_t>(i + k);
+            down_.queued.push_back(s_.interval ? s_.due(msg) : now);
+            down_.mid.push_back(land);
+        }
+        return n;
+    }
+
+    uint64_t out_next() override
+    {
+        if (!s_.on() || stopped_)
+            return UINT64_MAX;
+        if (!s_.interval)
+            return 0;
+        const unsigned msg = static_cast<unsigned>(down_.queued.size()) / s_.size;
+        return msg < s_.messages() ? s_.due(msg) : UINT64_MAX;
+    }
+
+    void in_data(uint64_t now, const uint8_t* p, unsigned n, uint64_t armed) override
+    {
+        for (unsigned k = 0; k < n; ++k)
+            up_.arrive(p[k], armed, now, window_);
+    }
+
+private:
+    const Schedule& s_;
+    Stream& down_;
+    Stream& up_;
+    uint64_t window_;
+    bool stopped_ = false;
+};
+
+// Pc-pic's peripherals: the EUSART and endpoint 1 of the SIE.
+class Board : public host::PortDevice {
+public:
+    Board(Eusart& uart, UsbSie& sie) : uart_(uart), sie_(sie) {}
+
+    void port_changed(unsigned addr) override { uart_.port_changed(addr); }
+    uint8_t port_input(unsigned addr) override { return uart_.port_input(addr); }
+    void reg_write(unsigned addr, uint8_t v) override { uart_.reg_write(addr, v); }
+    uint8_t reg_read(unsigned addr) override { return uart_.reg_read(addr); }
+    bool irq_flag(int which) override
+    {
+        return which == INT_USB ? sie_.pending() : uart_.irq_flag(which);
+    }
+    uint64_t next_event_ns() override { return std::min(uart_.next_event_ns(), sie_.next_event_ns()); }
+    void advance_to(uint64_t now) override
+    {
+        uart_.advance_to(now);
+        sie_.advance_to(now);
+    }
+
+private:
+    Eusart& uart_;
+    UsbSie& sie_;
+};
+
+struct Result {
+    Stream down, up;
+    BridgeCounters bridge;
+    double isr = 0;
+    std::string why;
+};
+
+Result run(const Link& link, const Case& c, host::Cpu* cpu_a, host::Cpu* cpu_b)
+{
+    Result r;
+    const double byte_ns = 10e9 / link.bridge.baud_actual;
+    const uint64_t window = static_cast<uint64_t>(kWindowBytes * byte_ns);
+    const uint64_t stop = window + static_cast<uint64_t>(kDrainBytes * byte_ns) + kDrainNs;
+    const auto interval = [&](unsigned size) {
+        return c.load ? static_cast<uint64_t>(size * byte_ns * 100 / c.load) : 0;
+    };
+    const Schedule down{c.down, interval(c.down), window};
+    const Schedule up{c.up, interval(c.up), window};
+
+    PtyLink pty;
+    Pc pc(down, r.down, r.up, window);
+    UsbSie sie(&pc);
+    Eusart uart_a(HOST_CLOCK, &pty.forward(), &pty.back());
+    Eusart uart_b(HOST_CLOCK, &pty.back(), &pty.forward());
+    Board board(uart_a, sie);
+
+    try {
+        host::select(cpu_a);
+        host::reset();
+        host::attach(&board);
+        link.bridge.setup(&sie);
+        uint64_t now_a = host_now_ns;
+        host::select(cpu_b);
+        host::reset();
+        host::attach(&uart_b);
+        link.tx.setup();
+        link.rx.setup();
+        uint64_t now_b = host_now_ns;
+
+        // One main loop pass of PIC B, selected.
+        unsigned up_msgs = 0;
+        const auto pass_b = [&] {
+            const uint64_t t = host_now_ns;
+            if (up.on() && t < window && up_msgs < up.messages() && t >= up.due(up_msgs)) {
+                const unsigned i = static_cast<unsigned>(r.up.queued.size());
+                const unsigned n = up.interval ? up.size : kBurst;
+                uint8_t p[256];
+                for (unsigned k = 0; k < n; ++k)
+                    p[k] = static_cast<uint8_t>(i + k);
+                if (link.tx.put(p, n)) {
+                    r.up.queued.insert(r.up.queued.end(), n, t);
+                    ++up_msgs;
+                }
+            }
+            for (int b; (b = link.rx.get()) >= 0;)
+                r.down.arrive(static_cast<uint8_t>(b), 0, host_now_ns, window);
+            host_delay_ns(kLoopNs);
+            now_b = host_now_ns;
+        };
+        // Pc-pic's interrupts run longer than a byte time at 1 Mbaud: PIC B
+        // sends what it has up to the moment Pc-pic looks at the line.
+        bool nested = false;
+        pty.back().set_catch_up([&](uint64_t t) {
+            if (nested || now_b >= t)
+                return;
+            nested = true;
+            host::select(cpu_b);
+            while (now_b < t)
+                pass_b();
+            host::select(cpu_a);
+            nested = false;
+        });
+
+        while (now_a < stop || now_b < stop) {
+            if (now_a <= now_b) {
+                host::select(cpu_a);
+                host_delay_ns(kLoopNs);             // TareaUSB returns at once in bridge mode
+                now_a = host_now_ns;
+            } else {
+                host::select(cpu_b);
+                pass_b();
+            }
+        }
+        pty.back().set_catch_up(nullptr);
+        host::select(cpu_a);
+        r.isr = 100.0 * host::isr_ns() / host_now_ns;
+    } catch (const std::exception& e) {
+        r.why = e.what();
+    }
+    host::attach(nullptr);
+    host::select(cpu_b);
+    host::attach(nullptr);
+    host::select(nullptr);
+
+    r.bridge = link.bridge.counters();
+    for (Stream* s : {&r.down, &r.up})
+        s->lost += static_cast<unsigned>(s->queued.size()) - std::min<unsigned>(s->next, s->queued.size());   // never arrived
+
+    if (r.why.empty() && (r.down.lost || r.down.bad || r.up.lost || r.up.bad))
+        r.why = "lost or wrong bytes";
+    if (r.why.empty() && (r.bridge.rx_overruns || r.bridge.rx_framing || r.bridge.rx_dropped))
+        r.why = "Pc-pic receive errors";
+    if (r.why.empty() && ((c.down && !r.down.received) || (c.up && !r.up.received)))
+        r.why = "nothing delivered";
+    return r;
+}
+
+void print(const Link& l, const Case& c, const Result& r)
+{
+    const double window_s = kWindowBytes * 10.0 / l.bridge.baud_actual;
+    const double line = l.bridge.baud_actual / 10.0;
+    char load[8], down[8], up[8];
+    std::snprintf(load, sizeof load, c.load ? "%u%%" : "max", c.load);
+    std::snprintf(down, sizeof down, c.down ? "%u" : "-", c.down);
+    std::snprintf(up, sizeof up, c.up ? "%u" : "-", c.up);
+    std::printf("%7u %4s %4s %4s  %7.0f %5.1f %7.0f %5.1f  %7.1f %7.1f %7.1f %7.1f  %7.1f %7.1f "
+                "%7.1f %7.1f  %5u %5u %5u %4u  %5.1f%%  %s\n",
+                l.bridge.baud, down, up, load, r.down.in_window / window_s,
+                100.0 * r.down.in_window / window_s / line, r.up.in_window / window_s,
+                100.0 * r.up.in_window / window_s / line, r.down.first.avg_us(),
+                r.down.first.max_us(), r.down.second.avg_us(), r.down.second.max_us(),
+                r.up.first.avg_us(), r.up.first.max_us(), r.up.second.avg_us(),
+                r.up.second.max_us(), r.bridge.out_waits, r.bridge.in_full, r.bridge.in_flushed,
+                r.bridge.rx_overruns, r.isr, r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%7s %4s %4s %4s  %7s %5s %7s %5s  %15s %15s  %15s %15s  %5s %5s %5s %4s  %6s\n",
+                "", "", "", "", "", "", "", "", "usb out", "uart down", "uart up", "usb in", "", "",
+                "", "", "");
+    std::printf("%7s %4s %4s %4s  %7s %5s %7s %5s  %7s %7s %7s %7s  %7s %7s %7s %7s  %5s %5s %5s %4s  %6s\n",
+                "baud", "down", "up", "load", "down B/s", "line%", "up B/s", "line%", "avg us",
+                "max us", "avg us", "max us", "avg us", "max us", "avg us", "max us", "naks",
+                "full", "tmo", "oerr", "isr");
+
+    const std::vector<Link> links = {
+        {picusb::bridge_node_115200(), picusb::serial_node_tx_115200(),
+         picusb::serial_node_rxraw_115200()},
+        {picusb::bridge_node_1000000(), picusb::serial_node_tx_1000000(),
+         picusb::serial_node_rxraw_1000000()},
+    };
+    const Case cases[] = {
+        {32, 0, 0},             // PC -> PIC B as fast as it goes
+        {0, kBurst, 0},         // PIC B -> PC
+        {32, kBurst, 0},        // both at once
+        {16, 16, 10},           // light load both ways: the latency of each hop
+        {32, 16, 50},           // half the line each way
+    };
+
+    host::Cpu* cpu_a = host::new_cpu();
+    host::Cpu* cpu_b = host::new_cpu();
+    bool ok = true;
+    for (const Link& l : links)
+        for (const Case& c : cases) {
+            const Result r = run(l, c, cpu_a, cpu_b);
+            print(l, c, r);
+            ok = ok && r.why.empty();
+        }
+    return ok ? 0 : 1;
+}
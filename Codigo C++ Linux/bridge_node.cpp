@@ -0,0 +1,147 @@
+// bridge_node.cpp - the USB to UART bridge of Pc-pic built for the host
+// with the defines given on the command line (-DBRIDGE_NODE=bridge_<rate>,
+// -DUART_BAUD=rate).
+//
+// The parts of pic18_usb.c the bridge calls work on the UsbSie model; each
+// charges the instruction cycles the CCS driver spends in it, and the USB
+// interrupt charges the dispatch from usb_isr() down to usb_isr_tok_dne().
+#include "bridge_node.h"
+#include "ccs_host.h"
+
+#ifndef BRIDGE_NODE
+#error Define BRIDGE_NODE, see the Makefile
+#endif
+
+#define USB_EP1_TX_SIZE 32          // pc_usb.c
+#define USB_EP1_RX_SIZE 32
+#define USB_DTS_TOGGLE  2
+
+namespace {
+
+picusb::UsbSie* sie;
+
+} // namespace
+
+#define getenv(s) HOST_CLOCK
+namespace BRIDGE_NODE {
+#include "usb_uart_hooks_host.h"
+#include "uart_baud_host.h"
+#define UART_TX_SIZE 64             // pc_usb.c
+#define UART_RX_SIZE 64
+#include "uart_tx_host.h"
+#include "uart_rx_host.h"
+
+#define usb_ep1_rx_buffer (sie->out_buf)
+#define usb_ep1_tx_buffer (sie->in_buf)
+
+int1 usb_kbhit(int8)
+{
+    delay_cycles(12);
+    return sie->out_ready();
+}
+
+int1 usb_tbe(int8)
+{
+    delay_cycles(12);
+    return sie->in_free();
+}
+
+int16 usb_rx_packet_size(int8)
+{
+    delay_cycles(8);
+    return sie->out_len();
+}
+
+void usb_flush_out(int8, int8)
+{
+    delay_cycles(40);
+    sie->arm_out(host_now_ns);
+}
+
+int1 usb_flush_in(int8, int16 len, int8)
+{
+    delay_cycles(45);
+    return sie->arm_in(len, host_now_ns);
+}
+
+#include "usb_uart_host.h"
+
+void usb_isr()
+{
+    unsigned en;
+    bool out;
+
+    delay_cycles(80);
+    if (!sie->pop(&en, &out))
+        return;
+    if (out)
+        usb_on_out(en);
+    else
+        usb_on_in(en);
+}
+
+void tick_isr()
+{
+    delay_cycles(20);               // sched_isr(): reload Timer0, count the tick
+    sched_on_tick();
+}
+
+const unsigned host_baud_actual = UART_BAUD_ACTUAL;
+}
+#undef getenv
+
+#define BRIDGE_CAT2(a, b) a##b
+#define BRIDGE_CAT(a, b)  BRIDGE_CAT2(a, b)
+#define BRIDGE_STR2(a)    #a
+#define BRIDGE_STR(a)     BRIDGE_STR2(a)
+
+namespace {
+
+namespace fw = BRIDGE_NODE;
+
+void setup(picusb::UsbSie* s)
+{
+    sie = s;
+    fw::uart_tx_head = fw::uart_tx_tail = 0;
+    fw::uart_tx_full = 0;
+    fw::uart_rx_head = fw::uart_rx_tail = 0;
+    fw::usb_uart_on = FALSE;
+    host::set_isr(INT_TBE, fw::uart_tx_isr);
+    host::set_isr(INT_RDA, fw::uart_rx_isr);
+    host::set_isr(INT_USB, fw::usb_isr);
+    host::set_isr(INT_TIMER2, fw::tick_isr);
+    fw::uart_baud_setup();
+    enable_interrupts(INT_RDA);
+    enable_interrupts(INT_USB);
+    setup_timer_2(T2_DIV_BY_16, 249, 3);        // 1ms at 48MHz
+    enable_interrupts(INT_TIMER2);
+    enable_interrupts(GLOBAL);
+    fw::usb_uart_start();
+}
+
+picusb::BridgeCounters counters()
+{
+    picusb::BridgeCounters c;
+    c.out_bytes = fw::usb_uart_out_bytes;
+    c.in_bytes = fw::usb_uart_in_bytes;
+    c.out_waits = fw::usb_uart_out_waits;
+    c.in_full = fw::usb_uart_in_full;
+    c.in_flushed = fw::usb_uart_in_flushed;
+    c.rx_overruns = fw::uart_rx_overruns;
+    c.rx_framing = fw::uart_rx_framing;
+    c.rx_dropped = fw::uart_rx_dropped;
+    return c;
+}
+
+} // namespace
+
+picusb::BridgeNode picusb::BRIDGE_CAT(bridge_node_, UART_BAUD)()
+{
+    picusb::BridgeNode n{};
+    n.name = BRIDGE_STR(BRIDGE_NODE);
+    n.baud = UART_BAUD;
+    n.baud_actual = fw::host_baud_actual;
+    n.setup = setup;
+    n.counters = counters;
+    return n;
+}
@@ -0,0 +1,38 @@
+// bridge_node.h - the USB to UART bridge of Pc-pic (usb_uart.c with
+// uart_tx.c, uart_rx.c and uart_baud.h) running on the host.
+//
+// bridge_node.cpp is compiled once per UART_BAUD (see BRIDGE_BAUDS in the
+// Makefile) inside its own namespace and hands its entry points to
+// bridge_bench through this table.
+#pragma once
+
+#include "usb_sie.h"
+
+namespace picusb {
+
+struct BridgeCounters {
+    unsigned out_bytes = 0;         // usb_uart_out_bytes
+    unsigned in_bytes = 0;          // usb_uart_in_bytes
+    unsigned out_waits = 0;         // usb_uart_out_waits
+    unsigned in_full = 0;           // usb_uart_in_full
+    unsigned in_flushed = 0;        // usb_uart_in_flushed
+    unsigned rx_overruns = 0;       // uart_rx_overruns
+    unsigned rx_framing = 0;        // uart_rx_framing
+    unsigned rx_dropped = 0;        // uart_rx_dropped
+};
+
+struct BridgeNode {
+    const char* name;
+    unsigned baud;                  // UART_BAUD
+    unsigned baud_actual;           // UART_BAUD_ACTUAL
+    // Module state as at reset, handlers, uart_baud_setup(), the 1ms tick
+    // (Timer2 here, Timer0 in sched.c) and usb_uart_start() on a
+    // configured device whose endpoint 1 is sie.
+    void (*setup)(UsbSie* sie);
+    BridgeCounters (*counters)();
+};
+
+BridgeNode bridge_node_115200();
+BridgeNode bridge_node_1000000();
+
+} // namespace picusb
@@ -0,0 +1,298 @@
+// bus_bench - runs the multidrop bus of bus9.c: Envio's sender (frame.c,
+// bus9.c, uart_tx.c) and one Recibe per address (frame.c, bus9.c,
+// uart_rx.c, each built with its own BUS_ADDR), every one an emulated PIC,
+// all on one line at 1 Mbaud in 9 bit mode through the EUSART model of
+// eusart.h.  Reports the aggregate update rate against the number of
+// nodes; the exit status is 1 if any check fails.
+//
+//   bus_bench
+//
+// The sender does what TareaUART does once per main loop pass: bus_send()
+// the next update if the previous frame is out, to the nodes in turn
+// (unicast) or to all of them at once (broadcast).  Each node does what
+// TareaSalida does: take the waiting frame.  Main loop passes cost 100
+// instruction cycles, interrupts and register accesses come on top as in
+// serial_bench.
+//
+// Columns: nodes, addressing and update size; updates delivered per second
+// over all nodes and per node, and the share of the line the sender kept
+// busy; latency from bus_send() to the node taking the frame; the bytes a
+// node's EUSART let through (its own frames and every address byte) as a
+// share of the bytes on the line, the rest dropped by ADDEN without an
+// interrupt; time in interrupts, average of the nodes and the busiest one.
+//
+// Checks: every node gets exactly the updates sent to it or to all, in
+// order and intact, no node sees a receive error, and with unicast to
+// several nodes each one's EUSART lets only part of the line through.
+#include "ccs_host.h"
+#include "eusart.h"
+#include "serial_node.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using picusb::Eusart;
+using picusb::PtyLink;
+using picusb::SerialNode;
+
+constexpr uint64_t kCycleNs = 4000000000ULL / HOST_CLOCK;
+constexpr uint64_t kLoopNs = 100 * kCycleNs;
+constexpr unsigned kWindowBytes = 2000;      // measured time, in byte times of the line
+constexpr uint64_t kDrainNs = 2000000;       // then the sender stops and the nodes catch up
+constexpr uint8_t kFrameValue = 0x01;        // FRAME_T_VALUE in frame.c
+constexpr uint8_t kBroadcast = 0xFF;         // BUS_BROADCAST in bus9.c
+
+struct Case {
+    unsigned nodes;
+    bool broadcast;
+    unsigned size;          // bytes per update, at least 3
+};
+
+struct Result {
+    unsigned sent = 0;
+    unsigned good = 0;      // updates taken by a node, all nodes
+    unsigned in_window = 0;
+    unsigned lost = 0, bad = 0;
+    double lat_sum = 0;
+    uint64_t lat_max = 0;
+    double line = 0;        // busy share of the line inside the window
+    double seen = 0;        // bytes through a node's EUSART / bytes on the line
+    double isr_avg = 0, isr_max = 0;
+    unsigned errors = 0;    // node receive errors of any kind
+    std::string why;
+};
+
+// Update msg to dest: the address, the message number, then filler.
+void message(uint8_t dest, uint32_t msg, unsigned size, uint8_t* p)
+{
+    p[0] = dest;
+    p[1] = static_cast<uint8_t>(msg);
+    p[2] = static_cast<uint8_t>(msg >> 8);
+    for (unsigned i = 3; i < size; ++i)
+        p[i] = static_cast<uint8_t>(msg + i);
+}
+
+struct Sent {
+    uint8_t dest;
+    uint64_t at;
+};
+
+// What one node took, checked against what was sent.
+class Node {
+public:
+    Node(const SerialNode& n, const std::vector<Sent>& sent, uint64_t window, Result& r)
+        : n_(n), sent_(sent), window_(window), r_(r) {}
+
+    void take(uint64_t now)
+    {
+        uint8_t type, size, p[256];
+        while (n_.receive(&type, p, &size)) {
+            const uint32_t msg = p[1] | p[2] << 8;
+            uint8_t want[256];
+            if (msg < sent_.size())
+                message(sent_[msg].dest, msg, size, want);
+            if (type != kFrameValue || size < 3 || msg >= sent_.size() || (int)msg <= last_ ||
+                (p[0] != n_.bus_addr && p[0] != kBroadcast) || !std::equal(p, p + size, want)) {
+                ++r_.bad;
+                continue;
+            }
+            last_ = static_cast<int>(msg);
+            ++got_;
+            ++r_.good;
+            if (now <= window_)
+                ++r_.in_window;
+            const uint64_t lat = now - sent_[msg].at;
+            r_.lat_sum += lat;
+            r_.lat_max = std::max(r_.lat_max, lat);
+        }
+    }
+
+    // Updates sent to this node that it never took.
+    unsigned missing() const
+    {
+        unsigned want = 0;
+        for (const Sent& s : sent_)
+            want += s.dest == n_.bus_addr || s.dest == kBroadcast;
+        return want - std::min(want, got_);
+    }
+
+private:
+    const SerialNode& n_;
+    const std::vector<Sent>& sent_;
+    uint64_t window_;
+    Result& r_;
+    int last_ = -1;
+    unsigned got_ = 0;
+};
+
+Result run(const SerialNode& tx, const std::vector<SerialNode>& nodes, const Case& c,
+           host::Cpu* cpu_tx, const std::vector<host::Cpu*>& cpus)
+{
+    Result r;
+    const double byte_ns = 11e9 / tx.baud_actual;
+    const uint64_t window = static_cast<uint64_t>(kWindowBytes * byte_ns);
+    const uint64_t stop = window + kDrainNs;
+
+    // one pty per node, the sender's line tapped into the others
+    std::vector<std::unique_ptr<PtyLink>> ptys;
+    for (unsigned i = 0; i < c.nodes; ++i) {
+        ptys.push_back(std::make_unique<PtyLink>());
+        if (i)
+            ptys[0]->forward().tap(&ptys[i]->forward());
+    }
+    Eusart tx_uart(HOST_CLOCK, &ptys[0]->forward(), nullptr);
+    std::vector<std::unique_ptr<Eusart>> uarts;
+    std::vector<Sent> sent;
+    std::vector<Node> takers;
+    for (unsigned i = 0; i < c.nodes; ++i) {
+        uarts.push_back(std::make_unique<Eusart>(HOST_CLOCK, nullptr, &ptys[i]->forward()));
+        takers.emplace_back(nodes[i], sent, window, r);
+    }
+
+    try {
+        host::select(cpu_tx);
+        host::reset();
+        host::attach(&tx_uart);
+        tx.setup();
+        uint64_t now_tx = host_now_ns;
+        std::vector<uint64_t> now(c.nodes);
+        for (unsigned i = 0; i < c.nodes; ++i) {
+            host::select(cpus[i]);
+            host::reset();
+            host::attach(uarts[i].get());
+            nodes[i].setup();
+            now[i] = host_now_ns;
+        }
+
+        // One main loop pass of the sender, selected.
+        unsigned next = 0;
+        unsigned line_bytes = 0;
+        const auto pass_tx = [&] {
+            if (host_now_ns < window) {
+                const uint8_t dest = c.broadcast ? kBroadcast : nodes[next].bus_addr;
+                uint8_t p[256];
+                message(dest, static_cast<uint32_t>(sent.size()), c.size, p);
+                const uint64_t t = host_now_ns;
+                if (tx.bus_send(dest, kFrameValue, p, static_cast<uint8_t>(c.size))) {
+                    sent.push_back({dest, t});
+                    next = (next + 1) % c.nodes;
+                }
+                line_bytes = tx_uart.stats().sent;
+            }
+            host_delay_ns(kLoopNs);
+            now_tx = host_now_ns;
+        };
+        // A node looking at the line runs the sender up to its time first.
+        bool nested = false;
+        for (unsigned i = 0; i < c.nodes; ++i)
+            ptys[i]->forward().set_catch_up([&, i](uint64_t t) {
+                if (nested || now_tx >= t)
+                    return;
+                nested = true;
+                host::select(cpu_tx);
+                while (now_tx < t)
+                    pass_tx();
+                host::select(cpus[i]);
+                nested = false;
+            });
+
+        for (;;) {
+            unsigned k = 0;
+            for (unsigned i = 1; i < c.nodes; ++i)
+                if (now[i] < now[k])
+                    k = i;
+            if (now_tx >= stop && now[k] >= stop)
+                break;
+            if (now_tx <= now[k]) {
+                host::select(cpu_tx);
+                pass_tx();
+            } else {
+                host::select(cpus[k]);
+                takers[k].take(host_now_ns);
+                host_delay_ns(kLoopNs);
+                now[k] = host_now_ns;
+            }
+        }
+        for (unsigned i = 0; i < c.nodes; ++i)
+            ptys[i]->forward().set_catch_up(nullptr);
+
+        r.line = 100.0 * line_bytes * byte_ns / window;
+        for (unsigned i = 0; i < c.nodes; ++i) {
+            host::select(cpus[i]);
+            const double isr = 100.0 * host::isr_ns() / host_now_ns;
+            r.isr_avg += isr / c.nodes;
+            r.isr_max = std::max(r.isr_max, isr);
+            const Eusart::Stats& s = uarts[i]->stats();
+            r.seen += 100.0 * s.received / std::max(1u, tx_uart.stats().sent) / c.nodes;
+            const picusb::SerialCounters n = nodes[i].counters();
+            r.errors += n.rx_overruns + n.rx_framing + n.rx_dropped + n.crc_errors +
+                        n.bad_frames + n.dropped_frames;
+            r.lost += takers[i].missing();
+        }
+    } catch (const std::exception& e) {
+        r.why = e.what();
+    }
+    for (host::Cpu* cpu : cpus) {
+        host::select(cpu);
+        host::attach(nullptr);
+    }
+    host::select(cpu_tx);
+    host::attach(nullptr);
+    host::select(nullptr);
+
+    r.sent = static_cast<unsigned>(sent.size());
+    if (r.why.empty() && r.sent == 0)
+        r.why = "nothing sent";
+    if (r.why.empty() && (r.lost || r.bad))
+        r.why = "lost or wrong updates";
+    if (r.why.empty() && r.errors)
+        r.why = "node receive errors";
+    if (r.why.empty() && !c.broadcast && c.nodes > 1 && r.seen >= 100)
+        r.why = "ADDEN let other nodes' frames through";
+    return r;
+}
+
+void print(const SerialNode& tx, const Case& c, const Result& r)
+{
+    const double window_s = kWindowBytes * 11.0 / tx.baud_actual;
+    const double ups = r.in_window / window_s;
+    std::printf("%5u %-9s %4u  %6u %6u  %8.0f %7.0f %5.1f  %8.1f %8.1f  %5.1f  %5.1f%% %5.1f%%  %s\n",
+                c.nodes, c.broadcast ? "broadcast" : "unicast", c.size, r.sent, r.good, ups,
+                ups / c.nodes, r.line, r.good ? r.lat_sum / r.good / 1000.0 : 0.0,
+                r.lat_max / 1000.0, r.seen, r.isr_avg, r.isr_max,
+                r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%5s %-9s %4s  %6s %6s  %8s %7s %5s  %8s %8s  %5s  %6s %6s\n", "nodes", "to",
+                "size", "sent", "taken", "upd/s", "/node", "line%", "lat avg", "lat max",
+                "seen%", "isr", "max");
+
+    const SerialNode tx = picusb::serial_node_bustx_1000000();
+    std::vector<SerialNode> nodes = picusb::serial_bus_nodes();
+    std::sort(nodes.begin(), nodes.end(),
+              [](const SerialNode& a, const SerialNode& b) { return a.bus_addr < b.bus_addr; });
+
+    host::Cpu* cpu_tx = host::new_cpu();
+    std::vector<host::Cpu*> cpus;
+    for (size_t i = 0; i < nodes.size(); ++i)
+        cpus.push_back(host::new_cpu());
+
+    bool ok = true;
+    for (unsigned n = 1; n <= nodes.size(); n *= 2)
+        for (const Case& c : {Case{n, false, 4}, Case{n, false, 16}, Case{n, true, 4}}) {
+            const Result r = run(tx, nodes, c, cpu_tx, cpus);
+            print(tx, c, r);
+            ok = ok && r.why.empty();
+        }
+    return ok ? 0 : 1;
+}
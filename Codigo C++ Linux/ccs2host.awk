@@ -0,0 +1,103 @@
+# ccs2host.awk - turns a CCS PIC C source into C++ that compiles on the host
+# against ccs_host.h.
+#
+#   awk -f ccs2host.awk FILE.c FILE.c > FILE_host.h     (the file twice)
+#
+# The first pass finds the "#byte name = addr" mappings and the struct
+# instances they place on a port; the second pass rewrites:
+#
+#   - bit fields of a mapped struct (BOOLEAN / int1 x;  int x : N;) into
+#     HostBits<addr, bit, width> members, so every write reaches the
+#     emulated port;
+#   - "#byte x = addr" of a plain variable and "#bit x = addr.n" into
+#     HostBits declarations;
+#   - "#int_xxx", "#inline", "#separate" into blank lines;
+#   - "signed int8/16/32" into sint8/16/32;
+#   - empty busy waits "while (cond) ;" into "while (cond) host_idle();",
+#     so emulated interrupts get to run.
+#
+# Line numbers are kept, so compiler messages point into the original file.
+
+FNR == 1 { pass++ }
+
+pass == 1 {
+    if ($1 == "#byte" && $3 == "=")
+        addr[$2] = $4
+    if ($1 == "struct" && $3 == "{")
+        open_struct = $2
+    if (open_struct != "" && $0 ~ /^[ \t]*}[ \t]*[A-Za-z_][A-Za-z0-9_]*[ \t]*;/) {
+        inst = $0
+        sub(/^[ \t]*}[ \t]*/, "", inst)
+        sub(/[ \t]*;.*/, "", inst)
+        instance[open_struct] = inst
+        placed[inst] = 1
+        open_struct = ""
+    }
+    next
+}
+
+FNR == 1 { print "#line 1 \"" FILENAME "\"" }
+
+{
+    line = $0
+
+    if (in_struct) {
+        if (line ~ /^[ \t]*}/) {
+            in_struct = 0
+        } else if (match(line, /^[ \t]*(BOOLEAN|int1)[ \t]+[A-Za-z_][A-Za-z0-9_]*[ \t]*;/)) {
+            sub(/(BOOLEAN|int1)/, "HostBits<" base "," bit ",1>", line)
+            bit++
+        } else if (match(line, /^[ \t]*(int|int8|BYTE)[ \t]+[A-Za-z_][A-Za-z0-9_]*[ \t]*:[ \t]*[0-9]+[ \t]*;/)) {
+            field = substr(line, RSTART, RLENGTH)
+            width = field
+            sub(/^[^:]*:[ \t]*/, "", width)
+            sub(/[ \t]*;.*/, "", width)
+            name = field
+            sub(/^[ \t]*(int|int8|BYTE)[ \t]+/, "", name)
+            sub(/[ \t]*:.*/, "", name)
+            rest = substr(line, RSTART + RLENGTH)
+            lead = line
+            sub(/[^ \t].*/, "", lead)
+            line = lead "HostBits<" base "," bit "," width "> " name ";" rest
+            bit += width
+        }
+        print line
+        next
+    }
+
+    if ($1 == "struct" && $3 == "{" && ($2 in instance) && (instance[$2] in addr)) {
+        in_struct = 1
+        base = addr[instance[$2]]
+        bit = 0
+        print line
+        next
+    }
+
+    if ($1 == "#byte") {
+        if ($2 in placed)
+            print ""
+        else
+            print "HostBits<" $4 ",0,8> " $2 ";"
+        next
+    }
+
+    if ($1 == "#bit") {
+        split($4, ab, ".")
+        print "HostBits<" ab[1] "," ab[2] ",1> " $2 ";"
+        next
+    }
+
+    if ($1 ~ /^#int_/ || $1 == "#inline" || $1 == "#separate") {
+        print ""
+        next
+    }
+
+    gsub(/signed int8/, "sint8", line)
+    gsub(/signed int16/, "sint16", line)
+    gsub(/signed int32/, "sint32", line)
+
+    if (line ~ /^[ \t]*while[ \t]*\(.*\)[ \t]*;/)
+        sub(/\)[ \t]*;/, ") host_idle();", line)
+
+    print line
+}
@@ -0,0 +1,352 @@
+// ccs_host.cpp - modelled time, ports and interrupts for ccs_host.h.
+#include "ccs_host.h"
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+uint64_t host_now_ns;
+
+namespace {
+
+constexpr uint64_t kCycleNs = 4000000000ULL / HOST_CLOCK;
+constexpr uint64_t kIsrOverheadNs = 40 * kCycleNs;   // CCS saves and restores context
+constexpr unsigned kIdleLimit = 1000000;             // host_idle() calls without progress
+constexpr uint64_t kNever = UINT64_MAX;
+
+// Interrupt sources in the order the CCS dispatcher polls them
+constexpr int kSources[] = {INT_TIMER2, INT_RDA, INT_TBE, INT_USB, INT_EXT, INT_EXT1, INT_EXT2};
+constexpr int kMaxSource = INT_EXT2;
+
+} // namespace
+
+namespace host {
+
+// Everything one emulated PIC has of its own; host_now_ns is its clock while
+// it is selected.
+struct Cpu {
+    uint64_t now = 0;
+    uint8_t latches[5] = {};
+    uint8_t trises[5] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    PortDevice* device = nullptr;
+    uint8_t adcon1 = 0;         // PBADEN: AN0..AN12, RB0..RB4 among them, analog
+
+    bool global_on = true;
+    bool enabled[kMaxSource + 1] = {};
+    void (*isr[kMaxSource + 1])() = {};
+    bool t2_flag = false;       // TMR2IF, set on every period match
+    bool ext_flag[3] = {};      // INT0IF..INT2IF
+    bool ext_rising[3] = {true, true, true};
+    uint8_t ext_pins = 0;       // RB0..RB2 when last looked at
+    bool in_isr = false;
+    uint64_t t2_period = 0;     // 0: Timer2 off
+    uint64_t t2_next = 0;       // next period match
+    uint64_t isr_total = 0;
+    unsigned idle_spins = 0;
+};
+
+void PortDevice::reg_write(unsigned, uint8_t)
+{
+    throw std::runtime_error("ccs_host: register not emulated");
+}
+
+uint8_t PortDevice::reg_read(unsigned)
+{
+    throw std::runtime_error("ccs_host: register not emulated");
+}
+
+} // namespace host
+
+namespace {
+
+host::Cpu first_cpu;
+host::Cpu* cpu = &first_cpu;
+std::vector<std::unique_ptr<host::Cpu>> more_cpus;
+
+constexpr unsigned kIntcon = 0xFF2;
+
+bool is_port(unsigned addr) { return addr >= 0xF80 && addr <= 0xF84; }
+bool is_lat(unsigned addr) { return addr >= 0xF89 && addr <= 0xF8D; }
+
+// INTCON of the model: only GIEH, which the hardware clears in a handler.
+uint8_t intcon() { return cpu->global_on && !cpu->in_isr ? 0x80 : 0; }
+
+unsigned port_index(unsigned addr)
+{
+    if (!is_port(addr))
+        throw std::runtime_error("ccs_host: port address not emulated");
+    return addr - 0xF80;
+}
+
+// RB0..RB4 are AN12, AN10, AN8, AN9, AN11; PCFG3:0 makes AN0 up to AN(13 -
+// PCFG) analog, all of them below 2.  An analog pin reads 0.
+uint8_t analog_b()
+{
+    static const uint8_t an[5] = {12, 10, 8, 9, 11};
+    const int pcfg = cpu->adcon1 & 0x0F;
+    uint8_t m = 0;
+    for (unsigned k = 0; k < 5; ++k)
+        if (pcfg <= 1 || an[k] <= 13 - pcfg)
+            m |= 1u << k;
+    return m;
+}
+
+uint8_t pins(unsigned i)
+{
+    uint8_t v = cpu->latches[i];
+    if (cpu->device)
+        v = static_cast<uint8_t>((v & ~cpu->trises[i]) |
+                                 (cpu->device->port_input(0xF80 + i) & cpu->trises[i]));
+    if (i == 1)
+        v &= ~analog_b();
+    return v;
+}
+
+bool is_ext(int which) { return which >= INT_EXT && which <= INT_EXT2; }
+
+// Latches the INTx flags on the edges RB0..RB2 made since the last look.
+void sample_ext()
+{
+    if (!cpu->enabled[INT_EXT] && !cpu->enabled[INT_EXT1] && !cpu->enabled[INT_EXT2])
+        return;
+    const uint8_t now = pins(1) & 7;
+    for (unsigned k = 0; k < 3; ++k) {
+        const bool was = cpu->ext_pins >> k & 1, is = now >> k & 1;
+        if (cpu->enabled[INT_EXT + k] && was != is && is == cpu->ext_rising[k])
+            cpu->ext_flag[k] = true;
+    }
+    cpu->ext_pins = now;
+}
+
+bool flag(int which)
+{
+    if (which == INT_TIMER2)
+        return cpu->t2_flag;
+    if (is_ext(which))
+        return cpu->ext_flag[which - INT_EXT];
+    return cpu->device && cpu->device->irq_flag(which);
+}
+
+bool can_run(int which)
+{
+    return cpu->enabled[which] && cpu->global_on && !cpu->in_isr && cpu->isr[which];
+}
+
+void run_isr(int which)
+{
+    const uint64_t start = host_now_ns;
+    if (which == INT_TIMER2)
+        cpu->t2_flag = false;           // peripheral flags are cleared by the handler
+    if (is_ext(which))
+        cpu->ext_flag[which - INT_EXT] = false;
+    cpu->in_isr = true;
+    host_now_ns += kIsrOverheadNs;
+    cpu->isr[which]();
+    cpu->in_isr = false;
+    cpu->isr_total += host_now_ns - start;
+    cpu->idle_spins = 0;
+}
+
+// Runs the handlers of the pending interrupts, as the dispatcher does, until
+// none is left; true if any ran.
+bool service()
+{
+    bool ran = false;
+    sample_ext();
+    for (unsigned loops = 0;; ++loops) {
+        int pending = -1;
+        for (int s : kSources)
+            if (can_run(s) && flag(s)) {
+                pending = s;
+                break;
+            }
+        if (pending < 0)
+            return ran;
+        if (loops > kIdleLimit)
+            throw std::runtime_error("ccs_host: interrupt handler does not clear its flag");
+        run_isr(pending);
+        ran = true;
+    }
+}
+
+uint64_t next_event()
+{
+    uint64_t t = cpu->t2_period ? cpu->t2_next : kNever;
+    if (cpu->device) {
+        const uint64_t d = cpu->device->next_event_ns();
+        if (d < t)
+            t = d;
+    }
+    return t;
+}
+
+// Advances the modelled time; interrupts taken on the way stretch it, as
+// they stretch a delay loop on the chip.
+void advance(uint64_t ns)
+{
+    uint64_t target = host_now_ns + ns;
+    for (uint64_t ev = next_event(); ev <= target; ev = next_event()) {
+        const uint64_t before = host_now_ns > ev ? host_now_ns : ev;
+        host_now_ns = before;
+        if (cpu->t2_period && cpu->t2_next <= host_now_ns) {
+            cpu->t2_next += cpu->t2_period;
+            cpu->t2_flag = true;
+        }
+        if (cpu->device)
+            cpu->device->advance_to(host_now_ns);
+        service();
+        target += host_now_ns - before;
+    }
+    if (target > host_now_ns)
+        host_now_ns = target;
+    if (cpu->device)
+        cpu->device->advance_to(host_now_ns);
+    if (cpu->enabled[INT_EXT] || cpu->enabled[INT_EXT1] || cpu->enabled[INT_EXT2])
+        service();                       // another PIC may have moved a pin meanwhile
+}
+
+bool any_enabled()
+{
+    for (int s : kSources)
+        if (cpu->enabled[s] && cpu->isr[s])
+            return true;
+    return false;
+}
+
+} // namespace
+
+void host_delay_ns(uint64_t ns)
+{
+    advance(ns);
+}
+
+void host_idle()
+{
+    if (service())
+        return;
+    const uint64_t ev = next_event();
+    if (ev == kNever || !any_enabled() || !cpu->global_on || cpu->in_isr ||
+        ++cpu->idle_spins > kIdleLimit)
+        throw std::runtime_error("ccs_host: busy wait that no interrupt can end");
+    advance(ev > host_now_ns ? ev - host_now_ns : 0);
+}
+
+void host_interrupts(int which, bool on)
+{
+    if (which == GLOBAL) {
+        cpu->global_on = on;
+    } else if (which > 0 && which <= kMaxSource) {
+        if (is_ext(which) && on && !cpu->enabled[which])
+            cpu->ext_pins = static_cast<uint8_t>((cpu->ext_pins & ~(1u << (which - INT_EXT))) |
+                                                 (pins(1) & (1u << (which - INT_EXT))));
+        cpu->enabled[which] = on;
+    }
+    if (on)
+        service();                       // the flag may already be set
+}
+
+void host_clear_interrupt(int which)
+{
+    if (which == INT_TIMER2)
+        cpu->t2_flag = false;
+    else if (is_ext(which))
+        cpu->ext_flag[which - INT_EXT] = false;
+}
+
+void host_ext_int_edge(unsigned n, unsigned edge)
+{
+    if (n < 3)
+        cpu->ext_rising[n] = edge == L_TO_H;
+}
+
+void host_setup_timer2(unsigned prescale, unsigned period, unsigned postscale)
+{
+    cpu->t2_period = prescale ? uint64_t(prescale) * (period + 1) * postscale * kCycleNs : 0;
+    cpu->t2_next = host_now_ns + cpu->t2_period;
+    cpu->t2_flag = false;
+}
+
+void host_setup_adc_ports(unsigned config)
+{
+    cpu->adcon1 = static_cast<uint8_t>(config & 0x3F);
+}
+
+void host_set_tris(unsigned addr, uint8_t tris)
+{
+    const unsigned i = port_index(addr - 0x12);
+    cpu->trises[i] = tris;
+    if (cpu->device)
+        cpu->device->port_changed(0xF80 + i);
+}
+
+void host_port_write(unsigned addr, unsigned bit, unsigned width, unsigned value)
+{
+    const uint8_t mask = static_cast<uint8_t>(((1u << width) - 1) << bit);
+    host_now_ns += kCycleNs;
+    if (is_lat(addr))
+        addr -= 9;
+    if (addr == kIntcon) {
+        if ((mask & 0x80) && !cpu->in_isr)      // retfie sets GIEH again anyway
+            host_interrupts(GLOBAL, ((value << bit) & 0x80) != 0);
+        return;
+    }
+    if (!is_port(addr)) {
+        if (!cpu->device)
+            throw std::runtime_error("ccs_host: register not emulated");
+        const uint8_t old = width == 8 ? 0 : cpu->device->reg_read(addr);
+        cpu->device->reg_write(addr, static_cast<uint8_t>((old & ~mask) | ((value << bit) & mask)));
+        return;
+    }
+    const unsigned i = port_index(addr);
+    cpu->latches[i] = static_cast<uint8_t>((cpu->latches[i] & ~mask) | ((value << bit) & mask));
+    if (cpu->device)
+        cpu->device->port_changed(addr);
+}
+
+unsigned host_port_read(unsigned addr, unsigned bit, unsigned width)
+{
+    uint8_t v;
+    if (is_lat(addr)) {
+        v = cpu->latches[port_index(addr - 9)];
+    } else if (addr == kIntcon) {
+        v = intcon();
+    } else if (!is_port(addr)) {
+        if (!cpu->device)
+            throw std::runtime_error("ccs_host: register not emulated");
+        v = cpu->device->reg_read(addr);
+    } else {
+        v = pins(port_index(addr));
+    }
+    host_now_ns += kCycleNs;
+    return (v >> bit) & ((1u << width) - 1);
+}
+
+namespace host {
+
+void reset()
+{
+    *cpu = Cpu();
+    host_now_ns = 0;
+}
+
+void attach(PortDevice* dev) { cpu->device = dev; }
+void set_isr(int which, void (*isr)()) { cpu->isr[which] = isr; }
+void set_timer2_isr(void (*isr)()) { set_isr(INT_TIMER2, isr); }
+uint8_t latch(unsigned port) { return cpu->latches[port_index(port)]; }
+uint8_t tris(unsigned port) { return cpu->trises[port_index(port)]; }
+uint64_t isr_ns() { return cpu->isr_total; }
+
+Cpu* new_cpu()
+{
+    more_cpus.push_back(std::make_unique<Cpu>());
+    return more_cpus.back().get();
+}
+
+void select(Cpu* c)
+{
+    cpu->now = host_now_ns;
+    cpu = c ? c : &first_cpu;
+    host_now_ns = cpu->now;
+}
+
+} // namespace host
@@ -0,0 +1,182 @@
+// ccs_host.h - just enough of the CCS PIC C environment to run firmware
+// sources on Linux.
+//
+// Sources go through ccs2host.awk first (see the Makefile); the port
+// overlays it produces are HostBits members that call host_port_write() and
+// host_port_read(), so an emulated device can watch the pins.  Time is
+// modelled, not measured: delay_us()/delay_ms()/delay_cycles() and one
+// instruction cycle per register access advance host_now_ns, and Timer2
+// interrupts fire when the modelled time crosses their period.  Busy wait
+// loops call host_idle(), which jumps to the next interrupt.
+//
+// INT_EXT, INT_EXT1 and INT_EXT2 latch their flag on the ext_int_edge()
+// edge of RB0, RB1 and RB2, looked at whenever the modelled time moves.
+// Only edges while the interrupt is enabled count.
+//
+// INTCON (0xFF2) has only GIEH: it reads 0 inside an interrupt and while
+// interrupts are off, and writing it outside one is enable_interrupts() or
+// disable_interrupts() of GLOBAL.
+//
+// RB0..RB4 come out of reset analog, as with #FUSES PBADEN, and read 0
+// until setup_adc_ports() makes them digital.
+//
+// LATA..LATE write the same latches as PORTA..PORTE and read them back
+// rather than the pins.  Other registers go to the attached PortDevice,
+// which can also raise the INT_RDA/INT_TBE/INT_USB flags and schedule its
+// own events (the UART and USB models do).  Several PICs can run in one
+// process: each host::Cpu has its own clock, ports, interrupts and device,
+// and host::select() picks the one the firmware calls act on.
+//
+// getenv("CLOCK") is left to the file that includes the firmware, as
+// getenv clashes with the C library:
+//
+//   #define getenv(s) HOST_CLOCK
+//   #include "lcd416_host.h"
+//   #undef getenv
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifndef HOST_CLOCK
+#define HOST_CLOCK 48000000                  // pc_usb.c: #use delay(clock=48000000)
+#endif
+
+typedef uint8_t  BYTE;
+typedef uint8_t  int8;
+typedef uint16_t int16;
+typedef uint32_t int32;
+typedef bool     int1;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define make8(v,i)       ((BYTE)((v) >> (8 * (i))))
+#define make16(h,l)      ((int16)((h) << 8 | (l)))
+#define bit_test(x,b)    (((x) >> (b)) & 1)
+#define bit_set(x,b)     ((x) |= (1UL << (b)))
+#define bit_clear(x,b)   ((x) &= ~(1UL << (b)))
+
+#define delay_cycles(n)  host_delay_ns((uint64_t)(n) * 4000000000ULL / HOST_CLOCK)
+#define delay_us(n)      host_delay_ns((uint64_t)(n) * 1000)
+#define delay_ms(n)      host_delay_ns((uint64_t)(n) * 1000000)
+
+#define set_tris_a(x)    host_set_tris(0xF92, host_pack(x))
+#define set_tris_b(x)    host_set_tris(0xF93, host_pack(x))
+#define set_tris_c(x)    host_set_tris(0xF94, host_pack(x))
+#define set_tris_d(x)    host_set_tris(0xF95, host_pack(x))
+#define set_tris_e(x)    host_set_tris(0xF96, host_pack(x))
+
+#define GLOBAL           0
+#define INT_TIMER2       2
+#define INT_RDA          3
+#define INT_TBE          4
+#define INT_USB          5
+#define INT_EXT          6
+#define INT_EXT1         7
+#define INT_EXT2         8
+#define enable_interrupts(x)  host_interrupts(x, true)
+#define disable_interrupts(x) host_interrupts(x, false)
+#define clear_interrupt(x)    host_clear_interrupt(x)
+
+#define L_TO_H           0x40
+#define H_TO_L           0
+#define ext_int_edge(n, e)    host_ext_int_edge(n, e)
+
+#define T2_DISABLED      0
+#define T2_DIV_BY_1      1
+#define T2_DIV_BY_4      4
+#define T2_DIV_BY_16     16
+#define setup_timer_2(mode, period, postscale) host_setup_timer2(mode, period, postscale)
+
+#define NO_ANALOGS       0x0F                // 18F4550.h: PCFG3:0 of ADCON1
+#define AN0              0x0E
+#define VSS_VDD          0x00
+#define setup_adc_ports(x)    host_setup_adc_ports(x)
+
+extern uint64_t host_now_ns;
+
+void host_delay_ns(uint64_t ns);
+void host_idle();
+void host_interrupts(int which, bool on);
+void host_clear_interrupt(int which);
+void host_ext_int_edge(unsigned n, unsigned edge);
+void host_setup_timer2(unsigned prescale, unsigned period, unsigned postscale);
+void host_setup_adc_ports(unsigned config);
+void host_set_tris(unsigned addr, uint8_t tris);
+void host_port_write(unsigned addr, unsigned bit, unsigned width, unsigned value);
+unsigned host_port_read(unsigned addr, unsigned bit, unsigned width);
+
+// A field of a port overlay.  Each member holds its own bits in place, so
+// OR-ing the bytes of a struct made of them gives the port value (used for
+// set_tris_x(LCD_WRITE) and the like).
+template <unsigned A, unsigned B, unsigned W>
+struct HostBits {
+    static constexpr uint8_t kMask = static_cast<uint8_t>(((1u << W) - 1) << B);
+    uint8_t bits;
+
+    HostBits(unsigned v = 0) : bits(static_cast<uint8_t>((v << B) & kMask)) {}
+    HostBits& operator=(unsigned v)
+    {
+        bits = static_cast<uint8_t>((v << B) & kMask);
+        host_port_write(A, B, W, v);
+        return *this;
+    }
+    HostBits& operator=(const HostBits& o) { return *this = unsigned(o); }
+    operator unsigned() const { return host_port_read(A, B, W); }
+};
+
+inline uint8_t host_pack(unsigned v) { return static_cast<uint8_t>(v); }
+inline uint8_t host_pack(int v) { return static_cast<uint8_t>(v); }
+
+template <class T>
+uint8_t host_pack(const T& s)
+{
+    uint8_t v = 0;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&s);
+    for (size_t i = 0; i < sizeof s; ++i)
+        v |= p[i];
+    return v;
+}
+
+namespace host {
+
+// Called after a port latch or direction changed, and to read a port: pins
+// configured as inputs return whatever the emulated device drives.
+struct PortDevice {
+    virtual ~PortDevice() = default;
+    virtual void port_changed(unsigned addr) = 0;
+    virtual uint8_t port_input(unsigned addr) = 0;
+
+    // Other special function registers; the defaults throw.  A partial
+    // write (a #bit) is a read followed by a write of the whole byte.
+    virtual void reg_write(unsigned addr, uint8_t value);
+    virtual uint8_t reg_read(unsigned addr);
+
+    // Flag of a peripheral interrupt source (INT_RDA, INT_TBE, INT_USB).
+    virtual bool irq_flag(int) { return false; }
+
+    // Time of the next change the device makes by itself, UINT64_MAX for
+    // none; advance_to() is called when the modelled time reaches it.
+    virtual uint64_t next_event_ns() { return UINT64_MAX; }
+    virtual void advance_to(uint64_t) {}
+};
+
+struct Cpu;
+
+void reset();                                // the selected Cpu, back to power on
+void attach(PortDevice* dev);
+void set_isr(int which, void (*isr)());      // the #int_xxx handler of a source
+void set_timer2_isr(void (*isr)());
+Cpu* new_cpu();                              // one more PIC, lives until exit
+void select(Cpu* cpu);                       // nullptr: the first one
+uint8_t latch(unsigned port);                // 0xF80 PORTA ... 0xF84 PORTE
+uint8_t tris(unsigned port);
+uint64_t isr_ns();                           // modelled time spent in interrupts
+
+} // namespace host
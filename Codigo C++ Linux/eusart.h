@@ -0,0 +1,454 @@
+// eusart.h - model of the PIC18F4550 EUSART in asynchronous mode, and of
+// the line between two of them, carried by a pseudo-terminal pair.
+//
+// Eusart is the host::PortDevice of one emulated PIC: it answers PIR1,
+// RCSTA, TXSTA, TXREG, RCREG, SPBRG, SPBRGH and BAUDCON and raises the
+// INT_RDA/INT_TBE flags.  Registers start as "#use rs232" leaves them
+// (SPEN, TXEN and CREN set).  The bit time comes from SPBRGH:SPBRG, BRG16
+// and BRGH and the clock, so a byte written to TXREG occupies the line for
+// 10 bit times; TXREG and the shift register give the one byte of slack
+// the chip has.
+//
+// The receiver samples each byte in the middle of its own bit times over
+// the sender's waveform: if the two rates differ too much the data comes
+// out wrong and the stop bit reads 0 (FERR), as on the chip.  The two byte
+// FIFO overflows into OERR, after which nothing is received until CREN is
+// cleared.  ABDEN measures the next byte and loads SPBRGH:SPBRG with the
+// divisor of its rate (ABDOVF if it does not fit).
+//
+// TX9 adds the TX9D bit after the data (11 bit times a byte); RX9 samples
+// it into RX9D.  With RX9 and ADDEN the receiver drops every byte whose
+// ninth bit is 0 without raising RCIF, the address detect of multidrop
+// buses.
+//
+// A Line is one direction: the bytes go through the pseudo terminal (raw
+// mode) and their start time and bit time through a queue next to it.  It
+// can inject errors per byte: a flipped data bit, a stop bit held low or a
+// byte lost altogether, at random or (lose()) the next few bytes sent.
+// tap() joins another Line to one so every byte sent reaches both, as the
+// receivers on a multidrop bus.  A receiver whose PIC runs ahead of the
+// sender's by more than a byte time would miss bytes still to be sent into
+// its past; a catch-up callback on the Line lets the sending PIC run up to
+// the receiver's time first.  PtyLink is the pair of Lines over one pty,
+// master to slave and back.
+//
+// A Line also carries the hardware flow control wire of uart_rx.c and
+// uart_tx.c: the receiving PIC drives it from RB3 (RTS, once RB3 is an
+// output) and the sending PIC reads it on RB2 (CTS), high to stop.
+#pragma once
+
+#include "ccs_host.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <pty.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+namespace picusb {
+
+class Line {
+public:
+    struct Symbol {
+        uint64_t start_ns;      // falling edge of the start bit
+        double bit_ns;
+        bool stop_low;          // injected: stop bit held low
+        bool nine;              // 9 data bits (TX9)
+        bool bit9;              // the ninth (TX9D)
+    };
+
+    struct Stats {
+        unsigned bytes = 0;
+        unsigned flipped = 0;
+        unsigned stop_low = 0;
+        unsigned lost = 0;
+    };
+
+    Line(int write_fd, int read_fd) : wfd_(write_fd), rfd_(read_fd) {}
+
+    // Per byte error probability; a third each of flips, stop bits and losses.
+    void set_errors(double rate, unsigned seed)
+    {
+        rate_ = rate;
+        rng_.seed(seed);
+    }
+
+    // The next n bytes sent are lost, as in a burst of noise.
+    void lose(unsigned n) { lose_ = n; }
+
+    // Called with the receiver's time before it looks at the line.
+    void set_catch_up(std::function<void(uint64_t)> f) { catch_up_ = std::move(f); }
+    void catch_up(uint64_t now)
+    {
+        if (catch_up_)
+            catch_up_(now);
+    }
+
+    // Every byte sent on this line also goes on l (with its own errors).
+    void tap(Line* l) { taps_.push_back(l); }
+
+    // The flow control wire, high while the receiver wants no more bytes.
+    void set_hold(bool h) { hold_ = h; }
+    bool hold() const { return hold_; }
+
+    void send(uint8_t b, uint64_t start_ns, double bit_ns, bool nine = false, bool bit9 = false)
+    {
+        for (Line* l : taps_)
+            l->send(b, start_ns, bit_ns, nine, bit9);
+        ++stats_.bytes;
+        if (lose_) {
+            --lose_;
+            ++stats_.lost;
+            return;
+        }
+        Symbol s{start_ns, bit_ns, false, nine, bit9};
+        if (rate_ > 0 && uniform_(rng_) < rate_) {
+            const unsigned kind = rng_() % 3;
+            if (kind == 0) {
+                b ^= static_cast<uint8_t>(1u << (rng_() % 8));
+                ++stats_.flipped;
+            } else if (kind == 1) {
+                s.stop_low = true;
+                ++stats_.stop_low;
+            } else {
+                ++stats_.lost;
+                return;
+            }
+        }
+        if (::write(wfd_, &b, 1) != 1)
+            throw std::runtime_error("Line: pty write failed");
+        symbols_.push_back(s);
+    }
+
+    bool pending() const { return !symbols_.empty(); }
+    const Symbol& front() const { return symbols_.front(); }
+
+    // The byte of front(); it is in the pty already, possibly not through
+    // the line discipline yet.
+    uint8_t take()
+    {
+        pollfd p{rfd_, POLLIN, 0};
+        if (::poll(&p, 1, 1000) != 1)
+            throw std::runtime_error("Line: byte did not come out of the pty");
+        uint8_t b;
+        if (::read(rfd_, &b, 1) != 1)
+            throw std::runtime_error("Line: pty read failed");
+        symbols_.pop_front();
+        return b;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    int wfd_, rfd_;
+    std::deque<Symbol> symbols_;
+    double rate_ = 0;
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    std::function<void(uint64_t)> catch_up_;
+    std::vector<Line*> taps_;
+    bool hold_ = false;
+    unsigned lose_ = 0;
+    Stats stats_;
+};
+
+class PtyLink {
+public:
+    PtyLink()
+    {
+        char name[128];
+        if (::openpty(&master_, &slave_, name, nullptr, nullptr) != 0)
+            throw std::runtime_error("PtyLink: openpty failed");
+        name_ = name;
+        termios t;
+        ::tcgetattr(slave_, &t);
+        ::cfmakeraw(&t);
+        ::tcsetattr(slave_, TCSANOW, &t);
+        forward_ = new Line(master_, slave_);
+        back_ = new Line(slave_, master_);
+    }
+    ~PtyLink()
+    {
+        delete forward_;
+        delete back_;
+        ::close(slave_);
+        ::close(master_);
+    }
+    PtyLink(const PtyLink&) = delete;
+    PtyLink& operator=(const PtyLink&) = delete;
+
+    Line& forward() { return *forward_; }      // master to slave
+    Line& back() { return *back_; }            // slave to master
+    const std::string& name() const { return name_; }
+
+private:
+    int master_ = -1, slave_ = -1;
+    std::string name_;
+    Line* forward_;
+    Line* back_;
+};
+
+class Eusart : public host::PortDevice {
+public:
+    struct Stats {
+        unsigned sent = 0;
+        unsigned received = 0;
+        unsigned framing = 0;   // bytes received with FERR
+        unsigned overruns = 0;  // bytes lost to a full FIFO or a stopped receiver
+        unsigned lost = 0;      // no start bit seen
+        unsigned ignored = 0;   // dropped by ADDEN, no interrupt
+    };
+
+    // tx: the line this UART drives, rx: the one it listens to (either may
+    // be null).
+    Eusart(unsigned clock_hz, Line* tx, Line* rx) : clock_(clock_hz), tx_(tx), rx_(rx) {}
+
+    // RB3 drives the hold wire of the line we listen to, RB2 reads the one
+    // of the line we drive; the other pins float high.
+    void port_changed(unsigned addr) override
+    {
+        if (addr == kPortb && rx_)
+            rx_->set_hold(!(host::tris(kPortb) & kRts) && (host::latch(kPortb) & kRts));
+    }
+    uint8_t port_input(unsigned addr) override
+    {
+        if (addr == kPortb)
+            return static_cast<uint8_t>(~kCts | (tx_ && tx_->hold() ? kCts : 0));
+        return 0xFF;
+    }
+
+    void reg_write(unsigned addr, uint8_t v) override
+    {
+        advance_to(host_now_ns);
+        switch (addr) {
+        case kRcsta:
+            if ((rcsta_ & kCren) && !(v & kCren))
+                oerr_ = false;
+            rcsta_ = v & ~(kFerr | kOerr | kRx9d);
+            break;
+        case kTxsta: txsta_ = v & ~kTrmt; break;
+        case kTxreg: write_txreg(v); break;
+        case kSpbrg: spbrg_ = v; break;
+        case kSpbrgh: spbrgh_ = v; break;
+        case kBaudcon: baudcon_ = v; break;
+        case kPir1: break;      // TXIF and RCIF are read only
+        default: PortDevice::reg_write(addr, v);
+        }
+    }
+
+    uint8_t reg_read(unsigned addr) override
+    {
+        advance_to(host_now_ns);
+        switch (addr) {
+        case kPir1:
+            return static_cast<uint8_t>((txreg_full_ ? 0 : kTxif) | (fifo_.empty() ? 0 : kRcif));
+        case kRcsta:
+            return static_cast<uint8_t>(rcsta_ | (oerr_ ? kOerr : 0) |
+                                        (!fifo_.empty() && fifo_.front().ferr ? kFerr : 0) |
+                                        (!fifo_.empty() && fifo_.front().bit9 ? kRx9d : 0));
+        case kTxsta:
+            return static_cast<uint8_t>(txsta_ | (trmt() ? kTrmt : 0));
+        case kRcreg: {
+            if (fifo_.empty())
+                return 0;
+            const uint8_t b = fifo_.front().data;
+            fifo_.pop_front();
+            return b;
+        }
+        case kTxreg: return 0;
+        case kSpbrg: return spbrg_;
+        case kSpbrgh: return spbrgh_;
+        case kBaudcon: return baudcon_;
+        default: return PortDevice::reg_read(addr);
+        }
+    }
+
+    bool irq_flag(int which) override
+    {
+        advance_to(host_now_ns);
+        if (which == INT_TBE)
+            return !txreg_full_;
+        if (which == INT_RDA)
+            return !fifo_.empty();
+        return false;
+    }
+
+    uint64_t next_event_ns() override
+    {
+        uint64_t t = txreg_full_ ? tsr_end_ : UINT64_MAX;
+        if (rx_ && rx_->pending()) {
+            const uint64_t a = arrival(rx_->front());
+            if (a < t)
+                t = a;
+        }
+        return t;
+    }
+
+    void advance_to(uint64_t now) override
+    {
+        while (txreg_full_ && tsr_end_ <= now) {
+            txreg_full_ = false;
+            start_tx(txreg_, txreg9_, tsr_end_);
+        }
+        if (rx_)
+            rx_->catch_up(now);
+        while (rx_ && rx_->pending() && arrival(rx_->front()) <= now)
+            receive();
+    }
+
+    // Bit time the registers give now.
+    double bit_ns() const
+    {
+        const bool brg16 = baudcon_ & kBrg16;
+        const bool brgh = txsta_ & kBrgh;
+        const unsigned div = brg16 ? (brgh ? 4 : 16) : (brgh ? 16 : 64);
+        const unsigned n = brg16 ? (spbrgh_ << 8 | spbrg_) : spbrg_;
+        return div * (n + 1.0) * 1e9 / clock_;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    static constexpr unsigned kPir1 = 0xF9E, kRcsta = 0xFAB, kTxsta = 0xFAC, kTxreg = 0xFAD,
+                              kRcreg = 0xFAE, kSpbrg = 0xFAF, kSpbrgh = 0xFB0, kBaudcon = 0xFB8;
+    static constexpr uint8_t kTxif = 0x10, kRcif = 0x20;
+    static constexpr uint8_t kSpen = 0x80, kRx9 = 0x40, kCren = 0x10, kAdden = 0x08,
+                             kFerr = 0x04, kOerr = 0x02, kRx9d = 0x01;
+    static constexpr uint8_t kTx9 = 0x40, kTxen = 0x20, kBrgh = 0x04, kTrmt = 0x02, kTx9d = 0x01;
+    static constexpr uint8_t kAbdovf = 0x80, kBrg16 = 0x08, kAbden = 0x01;
+    static constexpr unsigned kPortb = 0xF81;
+    static constexpr uint8_t kCts = 0x04, kRts = 0x08;
+
+    struct Rx {
+        uint8_t data;
+        bool ferr;
+        bool bit9;
+    };
+
+    bool trmt() const { return !txreg_full_ && host_now_ns >= tsr_end_; }
+
+    void write_txreg(uint8_t v)
+    {
+        if (!(rcsta_ & kSpen) || !(txsta_ & kTxen))
+            return;
+        const bool bit9 = txsta_ & kTx9d;    // goes with the byte, TX9D is set first
+        if (host_now_ns >= tsr_end_ && !txreg_full_) {
+            start_tx(v, bit9, host_now_ns);
+        } else {
+            txreg_ = v;          // overwrites a byte not yet moved on, as the chip
+            txreg9_ = bit9;
+            txreg_full_ = true;
+        }
+    }
+
+    void start_tx(uint8_t v, bool bit9, uint64_t at)
+    {
+        const double bit = bit_ns();
+        const bool nine = txsta_ & kTx9;
+        tsr_end_ = at + static_cast<uint64_t>(std::llround((nine ? 11 : 10) * bit));
+        ++stats_.sent;
+        if (tx_)
+            tx_->send(v, at, bit, nine, bit9);
+    }
+
+    // Middle of our stop bit.
+    uint64_t arrival(const Line::Symbol& s) const
+    {
+        const double bits = rcsta_ & kRx9 ? 10.5 : 9.5;
+        return s.start_ns + static_cast<uint64_t>(std::llround(bits * bit_ns()));
+    }
+
+    // Samples the sender's waveform in the middle of our bit times.
+    void receive()
+    {
+        const Line::Symbol s = rx_->front();
+        const uint8_t sent = rx_->take();
+        if (baudcon_ & kAbden) {
+            autobaud(s);
+            return;
+        }
+        const double bit = bit_ns();
+        auto level = [&](unsigned k) {
+            const unsigned j = static_cast<unsigned>((k + 0.5) * bit / s.bit_ns);
+            if (j == 0)
+                return 0;                             // start bit
+            if (j <= 8)
+                return (sent >> (j - 1)) & 1;
+            if (j == 9 && s.nine)
+                return s.bit9 ? 1 : 0;
+            if (j == (s.nine ? 10u : 9u))
+                return s.stop_low ? 0 : 1;
+            return 1;                                 // idle line after the byte
+        };
+        if (level(0) != 0) {                          // no start bit where we look
+            ++stats_.lost;
+            return;
+        }
+        uint8_t data = 0;
+        for (unsigned k = 1; k <= 8; ++k)
+            data |= static_cast<uint8_t>(level(k) << (k - 1));
+        const bool rx9 = rcsta_ & kRx9;
+        const bool bit9 = rx9 && level(9);
+        const bool ferr = level(rx9 ? 10 : 9) == 0;
+        if (!(rcsta_ & kSpen) || !(rcsta_ & kCren))
+            return;
+        if (rx9 && (rcsta_ & kAdden) && !bit9) {
+            ++stats_.ignored;
+            return;
+        }
+        if (oerr_ || fifo_.size() == 2) {
+            oerr_ = true;
+            ++stats_.overruns;
+            return;
+        }
+        fifo_.push_back({data, ferr, bit9});
+        ++stats_.received;
+        if (ferr)
+            ++stats_.framing;
+    }
+
+    // Loads the divisor that gives the rate of the byte just measured.
+    void autobaud(const Line::Symbol& s)
+    {
+        baudcon_ &= static_cast<uint8_t>(~kAbden);
+        const bool brg16 = baudcon_ & kBrg16;
+        const bool brgh = txsta_ & kBrgh;
+        const unsigned div = brg16 ? (brgh ? 4 : 16) : (brgh ? 16 : 64);
+        const double n = s.bit_ns * clock_ / 1e9 / div;
+        const long count = std::lround(n) - 1;
+        if (count > 65535 || (!brg16 && count > 255)) {
+            baudcon_ |= kAbdovf;
+        } else {
+            spbrg_ = static_cast<uint8_t>(count);
+            spbrgh_ = static_cast<uint8_t>(count >> 8);
+        }
+        if (fifo_.size() < 2)
+            fifo_.push_back({0, false, false});              // RCREG holds nothing useful
+    }
+
+    unsigned clock_;
+    Line* tx_;
+    Line* rx_;
+    uint8_t rcsta_ = kSpen | kCren;
+    uint8_t txsta_ = kTxen;
+    uint8_t baudcon_ = 0;
+    uint8_t spbrg_ = 0, spbrgh_ = 0;
+    uint8_t txreg_ = 0;
+    bool txreg9_ = false;
+    bool txreg_full_ = false;
+    uint64_t tsr_end_ = 0;
+    bool oerr_ = false;
+    std::deque<Rx> fifo_;
+    Stats stats_;
+};
+
+} // namespace picusb
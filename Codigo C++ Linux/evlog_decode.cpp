@@ -0,0 +1,95 @@
+// evlog_decode - turns a drain of the PicUSB event log into a timeline.
+//
+//   evlog_decode [--tick-us N] [capture.bin]    (reads stdin by default)
+//
+// The capture is the raw concatenation of the EP1 IN packets the device
+// sends for the TIPO_LOG (90) command; see "Codigo C/Pc-pic/evlog.c".
+// Timestamps are 16 bit and wrap (every 65.5 s with the 1 ms scheduler
+// tick pc_usb.c uses), so gaps between consecutive records are assumed to be
+// shorter than one wrap.  Times are printed relative to the first record,
+// with the age of each record at drain time taken from the packet header.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr unsigned char kMagic = 0xE1;
+constexpr size_t kRecord = 5;
+constexpr unsigned kEvLcd = 9;
+
+// Keep in sync with the EV_* ids in evlog.c.
+const char* event_name(unsigned id)
+{
+    static const char* const names[] = {
+        "?",          "BOOT",        "USB_RESET",  "USB_STALL",
+        "USB_ERROR",  "USB_SUSPEND", "USB_RESUME", "USB_CONFIG",
+        "CMD",        "LCD",         "LOST",       "USB_WAKE",
+    };
+    return id < sizeof names / sizeof names[0] ? names[id] : "?";
+}
+
+struct Record {
+    unsigned time, id, a, b;
+};
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    double tick_us = 1000.0; // sched_now() in pc_usb.c
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--tick-us") && i + 1 < argc)
+            tick_us = std::atof(argv[++i]);
+        else
+            path = argv[i];
+    }
+
+    FILE* in = stdin;
+    if (path && !(in = std::fopen(path, "rb"))) {
+        std::perror(path);
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    unsigned char chunk[4096];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof chunk, in)) > 0)
+        data.insert(data.end(), chunk, chunk + got);
+
+    std::vector<Record> records;
+    unsigned drain_time = 0;
+    for (size_t pos = 0; pos < data.size();) {
+        if (data.size() - pos < 4 || data[pos] != kMagic) {
+            std::fprintf(stderr, "evlog_decode: bad packet at offset %zu\n", pos);
+            return 1;
+        }
+        const size_t n = data[pos + 1];
+        drain_time = data[pos + 2] | (data[pos + 3] << 8);
+        if (data.size() - pos < 4 + n * kRecord) {
+            std::fprintf(stderr, "evlog_decode: truncated packet at offset %zu\n", pos);
+            return 1;
+        }
+        const unsigned char* r = &data[pos + 4];
+        for (size_t i = 0; i < n; ++i, r += kRecord)
+            records.push_back({unsigned(r[0] | (r[1] << 8)), r[2], r[3], r[4]});
+        pos += 4 + n * kRecord;
+    }
+
+    unsigned long long t = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Record& e = records[i];
+        if (i)
+            t += (e.time - records[i - 1].time) & 0xFFFF;
+        const unsigned age = (drain_time - e.time) & 0xFFFF;
+        std::printf("%12.3f ms  (-%9.3f ms)  %-12s %3u %3u",
+                    t * tick_us / 1000.0, age * tick_us / 1000.0,
+                    event_name(e.id), e.a, e.b);
+        if (e.id == kEvLcd)
+            std::printf("  (%u data bytes, then command 0x%02X)", e.a, e.b);
+        std::printf("\n");
+    }
+    std::fprintf(stderr, "evlog_decode: %zu records\n", records.size());
+    return 0;
+}
@@ -0,0 +1,229 @@
+// hd44780.h - pin level model of an HD44780 character LCD.
+//
+// The model is fed the RS, R/W, E and DB0..DB7 pin levels every time they
+// change and acts on the edges of E, like the controller: a falling edge
+// with R/W low writes a byte (or, on a 4 bit interface, half of one), a
+// high E with R/W high drives the busy flag and address counter or data
+// onto the bus.  It keeps DDRAM, CGRAM, the address counter and the
+// display/entry mode state, starts in 8 bit mode as after power on, and
+// follows the interface width set with function set.
+//
+// Execution times are the datasheet typicals at 270 kHz (37 us, 1.52 ms for
+// clear and home, 4.1 ms for the first function set after power on).
+// A write while the controller is busy, or an E pulse shorter than 450 ns,
+// counts as a timing violation; the write is still carried out.
+//
+// screen(row) gives what a 16x4 module (lines at 0x00, 0x40, 0x10, 0x50,
+// as lcd_gotoxy() in LCD416.C addresses them) shows.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace picusb {
+
+class Hd44780 {
+public:
+    static constexpr unsigned kRows = 4;
+    static constexpr unsigned kCols = 16;
+
+    struct Stats {
+        unsigned strobes = 0;        // E pulses with R/W low
+        unsigned reads = 0;          // E pulses with R/W high
+        unsigned commands = 0;
+        unsigned data = 0;
+        unsigned busy_violations = 0;
+        unsigned pulse_violations = 0;
+    };
+
+    Hd44780() { power_on(0); }
+
+    void power_on(uint64_t now_ns)
+    {
+        std::memset(ddram_, ' ', sizeof ddram_);
+        std::memset(cgram_, 0, sizeof cgram_);
+        ac_ = 0;
+        cgram_mode_ = false;
+        eight_bit_ = true;
+        two_lines_ = false;
+        increment_ = true;
+        shift_display_ = false;
+        display_on_ = false;
+        shift_ = 0;
+        low_nibble_ = false;
+        read_low_ = false;
+        first_function_set_ = true;
+        rs_ = rw_ = e_ = false;
+        db_ = 0;
+        busy_until_ = now_ns + 15000000;     // power on reset
+        stats_ = Stats();
+    }
+
+    // New pin levels at time now_ns.
+    void pins(bool rs, bool rw, bool e, uint8_t db, uint64_t now_ns)
+    {
+        if (e && !e_) {
+            e_rise_ = now_ns;
+        } else if (!e && e_) {
+            if (now_ns - e_rise_ < 450)
+                ++stats_.pulse_violations;
+            if (rw_)
+                end_read();
+            else
+                strobe(rs_, db_, now_ns);
+        }
+        rs_ = rs;
+        rw_ = rw;
+        e_ = e;
+        db_ = db;
+    }
+
+    // True while the controller drives DB0..DB7 (read cycle).
+    bool driving() const { return rw_ && e_; }
+
+    // The byte on the bus during a read at now_ns; on a 4 bit interface the
+    // current nibble is on DB4..DB7.
+    uint8_t bus_out(uint64_t now_ns) const
+    {
+        uint8_t v;
+        if (rs_)
+            v = cgram_mode_ ? cgram_[ac_ & 0x3F] : ddram_[ac_ & 0x7F];
+        else
+            v = static_cast<uint8_t>((now_ns < busy_until_ ? 0x80 : 0) | (ac_ & 0x7F));
+        if (eight_bit_)
+            return v;
+        return read_low_ ? static_cast<uint8_t>(v << 4) : static_cast<uint8_t>(v & 0xF0);
+    }
+
+    std::string screen(unsigned row) const
+    {
+        static const uint8_t base[kRows] = {0x00, 0x40, 0x10, 0x50};
+        std::string s;
+        for (unsigned c = 0; c < kCols; ++c) {
+            int off = (base[row] & 0x3F) + int(c) + shift_;
+            off = ((off % 40) + 40) % 40;
+            s += static_cast<char>(ddram_[(base[row] & 0x40) | off]);
+        }
+        return s;
+    }
+
+    const uint8_t* cgram() const { return cgram_; }
+    uint64_t busy_until() const { return busy_until_; }
+    bool four_bit() const { return !eight_bit_; }
+    bool display_on() const { return display_on_; }
+    const Stats& stats() const { return stats_; }
+    void clear_stats() { stats_ = Stats(); }
+
+private:
+    void strobe(bool rs, uint8_t db, uint64_t now_ns)
+    {
+        ++stats_.strobes;
+        if (now_ns < busy_until_)
+            ++stats_.busy_violations;
+        if (eight_bit_) {
+            execute(rs, db, now_ns);
+        } else if (!low_nibble_) {
+            high_ = db & 0xF0;
+            low_nibble_ = true;
+        } else {
+            low_nibble_ = false;
+            execute(rs, static_cast<uint8_t>(high_ | (db >> 4)), now_ns);
+        }
+    }
+
+    void end_read()
+    {
+        ++stats_.reads;
+        if (!eight_bit_) {
+            read_low_ = !read_low_;
+            if (read_low_)
+                return;
+        }
+        if (rs_)
+            step();
+    }
+
+    void execute(bool rs, uint8_t v, uint64_t now_ns)
+    {
+        uint64_t t = 37000;
+        if (rs) {
+            ++stats_.data;
+            if (cgram_mode_)
+                cgram_[ac_ & 0x3F] = v;
+            else
+                ddram_[ac_ & 0x7F] = v;
+            step();
+            if (shift_display_ && !cgram_mode_)
+                shift_ += increment_ ? 1 : -1;
+        } else {
+            ++stats_.commands;
+            if (v & 0x80) {
+                ac_ = v & 0x7F;
+                cgram_mode_ = false;
+            } else if (v & 0x40) {
+                ac_ = v & 0x3F;
+                cgram_mode_ = true;
+            } else if (v & 0x20) {
+                eight_bit_ = (v & 0x10) != 0;
+                two_lines_ = (v & 0x08) != 0;
+                low_nibble_ = read_low_ = false;
+                if (first_function_set_)
+                    t = 4100000;
+                first_function_set_ = false;
+            } else if (v & 0x10) {
+                if (v & 0x08)
+                    shift_ += (v & 0x04) ? 1 : -1;
+                else
+                    move(v & 0x04);
+            } else if (v & 0x08) {
+                display_on_ = (v & 0x04) != 0;
+            } else if (v & 0x04) {
+                increment_ = (v & 0x02) != 0;
+                shift_display_ = (v & 0x01) != 0;
+            } else if (v & 0x02) {
+                ac_ = 0;
+                cgram_mode_ = false;
+                shift_ = 0;
+                t = 1520000;
+            } else if (v & 0x01) {
+                std::memset(ddram_, ' ', sizeof ddram_);
+                ac_ = 0;
+                cgram_mode_ = false;
+                increment_ = true;
+                shift_ = 0;
+                t = 1520000;
+            }
+        }
+        busy_until_ = now_ns + t;
+    }
+
+    void step() { move(increment_); }
+
+    void move(bool up)
+    {
+        if (cgram_mode_) {
+            ac_ = (ac_ + (up ? 1 : 63)) & 0x3F;
+        } else if (!two_lines_) {
+            ac_ = up ? (ac_ >= 0x4F ? 0 : ac_ + 1) : (ac_ ? ac_ - 1 : 0x4F);
+        } else if (up) {
+            ac_ = ac_ == 0x27 ? 0x40 : ac_ == 0x67 ? 0x00 : (ac_ + 1) & 0x7F;
+        } else {
+            ac_ = ac_ == 0x40 ? 0x27 : ac_ == 0x00 ? 0x67 : ac_ - 1;
+        }
+    }
+
+    uint8_t ddram_[128];
+    uint8_t cgram_[64];
+    unsigned ac_;
+    bool cgram_mode_, eight_bit_, two_lines_, increment_, shift_display_, display_on_;
+    int shift_;
+    bool low_nibble_, read_low_, first_function_set_;
+    uint8_t high_ = 0;
+    bool rs_, rw_, e_;
+    uint8_t db_;
+    uint64_t e_rise_ = 0, busy_until_;
+    Stats stats_;
+};
+
+} // namespace picusb
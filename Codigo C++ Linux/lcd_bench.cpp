@@ -0,0 +1,276 @@
+// lcd_bench - runs LCD416.C against the HD44780 model and reports, per
+// driver configuration and screen update, the bus traffic and the modelled
+// time.  Every update is checked against the expected screen and for
+// timing violations; the exit status is 1 if any check fails, so
+// "make check" can guard driver changes.
+//
+//   lcd_bench
+//
+// Columns: E strobes (two per byte on a 4 bit bus, one on the 8 bit bus
+// of the *8 builds), commands and data bytes the
+// LCD executed, time spent in the driver calls, part of it in the Timer2
+// interrupt, and time until the LCD finished the last byte.  Modelled time
+// counts delays, port accesses and interrupt entry/exit, not the C code in
+// between, so "call us" of the interrupt driven driver is the time spent
+// waiting for room in its queue.  asyncq is that driver with a queue
+// shorter than a screen: lcd_flush() leaves what does not fit for its next
+// call instead of waiting.
+#include "ccs_host.h"
+#include "hd44780.h"
+#include "lcd_variant.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using picusb::Hd44780;
+using picusb::LcdDriver;
+
+class Bench : public host::PortDevice {
+public:
+    explicit Bench(const LcdDriver& d) : drv_(d) {}
+
+    void port_changed(unsigned addr) override
+    {
+        if (addr != drv_.ctrl_port && addr != drv_.data_port)
+            return;
+        // RS, E and R/W float low, the DB lines have pull-ups in the LCD
+        const uint8_t ctrl = level(drv_.ctrl_port, 0x00);
+        const uint8_t data = level(drv_.data_port, 0xFF);
+        lcd_.pins(ctrl & 1, drv_.rw_wired && (ctrl & 4), ctrl & 2,
+                  data & drv_.data_lines, host_now_ns);
+    }
+
+    uint8_t port_input(unsigned addr) override
+    {
+        if (addr == drv_.data_port && lcd_.driving())
+            return static_cast<uint8_t>(lcd_.bus_out(host_now_ns) | ~drv_.data_lines);
+        return addr == drv_.data_port ? 0xFF : 0x00;
+    }
+
+    Hd44780& lcd() { return lcd_; }
+
+private:
+    uint8_t level(unsigned port, uint8_t floating) const
+    {
+        const uint8_t t = host::tris(port);
+        return static_cast<uint8_t>((host::latch(port) & ~t) | (floating & t));
+    }
+
+    LcdDriver drv_;
+    Hd44780 lcd_;
+};
+
+struct Update {
+    const char* name;
+    std::function<void(const LcdDriver&)> run;
+    std::vector<std::string> screen;     // expected rows, empty: not checked
+};
+
+std::string row_of(const char* text)
+{
+    std::string s(text);
+    s.resize(Hd44780::kCols, ' ');
+    return s;
+}
+
+std::string printable(const std::string& s)
+{
+    std::string p(s);
+    for (char& c : p)
+        if (static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) > 0x7E)
+            c = '#';
+    return p;
+}
+
+std::vector<std::string> blank() { return std::vector<std::string>(Hd44780::kRows, row_of("")); }
+
+std::vector<Update> updates()
+{
+    std::vector<Update> u;
+    std::vector<std::string> s = blank();
+
+    u.push_back({"init", [](const LcdDriver& d) { d.init(); }, s});
+
+    s[0] = row_of("123");
+    u.push_back({"fb 3 digits", [](const LcdDriver& d) {
+        d.fb_gotoxy(1, 1);
+        for (const char* p = "123"; *p; ++p)
+            d.fb_putc(*p);
+        d.flush();
+    }, s});
+
+    s[0] = row_of("124");
+    u.push_back({"fb 1 digit", [](const LcdDriver& d) {
+        d.fb_gotoxy(1, 1);
+        for (const char* p = "124"; *p; ++p)
+            d.fb_putc(*p);
+        d.flush();
+    }, s});
+
+    for (unsigned r = 0; r < Hd44780::kRows; ++r)
+        for (unsigned c = 0; c < Hd44780::kCols; ++c)
+            s[r][c] = static_cast<char>('a' + (r * Hd44780::kCols + c) % 26);
+    u.push_back({"fb full", [](const LcdDriver& d) {
+        d.fb_gotoxy(1, 1);
+        for (unsigned i = 0; i < Hd44780::kRows * Hd44780::kCols; ++i)
+            d.fb_putc(static_cast<char>('a' + i % 26));
+        d.flush();
+    }, s});
+
+    // BancoLCD() in pc_usb.c
+    for (unsigned r = 0; r < Hd44780::kRows; ++r)
+        for (unsigned c = 0; c < Hd44780::kCols; ++c)
+            s[r][c] = static_cast<char>('0' + ((c + r + 1) & 7));
+    u.push_back({"redraw", [](const LcdDriver& d) {
+        for (uint8_t y = 1; y <= Hd44780::kRows; ++y) {
+            d.gotoxy(1, y);
+            for (uint8_t x = 0; x < Hd44780::kCols; ++x)
+                d.putc(static_cast<char>('0' + ((x + y) & 7)));
+        }
+    }, s});
+
+    s = blank();
+    s[0] = row_of("A");
+    u.push_back({"clear + 1", [](const LcdDriver& d) {
+        d.putc('\f');
+        d.putc('A');
+    }, s});
+
+    // the cursor is already there, no address command
+    s[0] = row_of("AB");
+    u.push_back({"gotoxy here", [](const LcdDriver& d) {
+        d.gotoxy(2, 1);
+        d.putc('B');
+    }, s});
+
+    s[0] = "ABCDEFGHIJKLMNOP";
+    s[1] = "QRSTUVWXYZ012345";
+    s[2] = row_of("6789");
+    s[3] = row_of("line 4");
+    u.push_back({"puts wrap", [](const LcdDriver& d) {
+        d.gotoxy(1, 1);
+        d.puts("ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789\nline 4");
+    }, s});
+
+    return u;
+}
+
+bool run(const LcdDriver& drv, bool expect_violations)
+{
+    Bench bench(drv);
+    host::reset();
+    host::attach(&bench);
+    drv.setup();
+
+    bool ok = true;
+    for (const Update& u : updates()) {
+        Hd44780& lcd = bench.lcd();
+        lcd.clear_stats();
+        const uint64_t t0 = host_now_ns;
+        const uint64_t isr0 = host::isr_ns();
+        std::string why;
+        try {
+            u.run(drv);
+        } catch (const std::exception& e) {
+            why = e.what();
+        }
+        const uint64_t t1 = host_now_ns;
+        if (why.empty()) {
+            try {
+                drv.wait();
+            } catch (const std::exception& e) {
+                why = e.what();
+            }
+        }
+        const uint64_t done = std::max(host_now_ns, lcd.busy_until());
+        host_delay_ns(done - host_now_ns);
+
+        const Hd44780::Stats& st = lcd.stats();
+        if (why.empty() && !expect_violations && st.busy_violations + st.pulse_violations)
+            why = std::to_string(st.busy_violations) + " busy, " +
+                  std::to_string(st.pulse_violations) + " pulse violations";
+        for (unsigned r = 0; why.empty() && r < u.screen.size(); ++r)
+            if (lcd.screen(r) != u.screen[r])
+                why = "row " + std::to_string(r + 1) + " is \"" + printable(lcd.screen(r)) +
+                      "\", expected \"" + printable(u.screen[r]) + "\"";
+        if (why.empty() && drv.dropped())
+            why = std::to_string(drv.dropped()) + " bytes dropped";
+        if (why.empty() && std::string(u.name) == "init" &&
+            !(lcd.four_bit() == (drv.data_lines != 0xFF) && lcd.display_on()))
+            why = "interface width or display state wrong after init";
+
+        std::printf("%-10s %-12s %7u %5u %5u %10.1f %9.1f %10.1f  %s\n",
+                    drv.name, u.name, st.strobes, st.commands, st.data,
+                    (t1 - t0) / 1000.0, (host::isr_ns() - isr0) / 1000.0,
+                    (done - t0) / 1000.0, why.empty() ? "ok" : ("FAIL: " + why).c_str());
+        ok = ok && why.empty();
+    }
+    host::attach(nullptr);
+    return ok;
+}
+
+// With interrupts off nothing empties a full queue: lcd_putc() has to drop
+// the bytes that do not fit instead of waiting for ever.
+bool run_ints_off(const LcdDriver& drv)
+{
+    Bench bench(drv);
+    host::reset();
+    host::attach(&bench);
+    drv.setup();
+    drv.init();
+
+    Hd44780& lcd = bench.lcd();
+    lcd.clear_stats();
+    const uint64_t t0 = host_now_ns;
+    std::string why;
+    try {
+        drv.gotoxy(1, 1);
+        disable_interrupts(GLOBAL);
+        for (unsigned i = 0; i < Hd44780::kCols; ++i)
+            drv.putc('x');
+        enable_interrupts(GLOBAL);
+        drv.wait();
+    } catch (const std::exception& e) {
+        why = e.what();
+    }
+    if (why.empty() && !drv.dropped())
+        why = "queue never full, nothing tested";
+    if (why.empty() && lcd.screen(0) != row_of(std::string(Hd44780::kCols - drv.dropped(), 'x').c_str()))
+        why = "row 1 is \"" + printable(lcd.screen(0)) + "\"";
+
+    const Hd44780::Stats& st = lcd.stats();
+    std::printf("%-10s %-12s %7u %5u %5u %10s %9s %10.1f  %s\n",
+                drv.name, "ints off", st.strobes, st.commands, st.data, "-", "-",
+                (host_now_ns - t0) / 1000.0, why.empty() ? "ok" : ("FAIL: " + why).c_str());
+    host::attach(nullptr);
+    return why.empty();
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-10s %-12s %7s %5s %5s %10s %9s %10s\n", "driver", "update",
+                "strobes", "cmds", "data", "call us", "isr us", "done us");
+
+    LcdDriver norw = picusb::lcd_driver_busy();
+    norw.name = "busy-norw";
+    norw.rw_wired = false;
+
+    bool ok = run(picusb::lcd_driver_delay(), false);
+    ok = run(picusb::lcd_driver_busy(), false) && ok;
+    ok = run(norw, false) && ok;              // the probe fails, no reads after init
+    ok = run(picusb::lcd_driver_async(), false) && ok;
+    ok = run(picusb::lcd_driver_asyncq(), false) && ok;
+    ok = run_ints_off(picusb::lcd_driver_asyncq()) && ok;
+    ok = run(picusb::lcd_driver_delay8(), false) && ok;
+    ok = run(picusb::lcd_driver_busy8(), false) && ok;
+    ok = run(picusb::lcd_driver_async8(), false) && ok;
+    return ok ? 0 : 1;
+}
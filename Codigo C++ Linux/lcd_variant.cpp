@@ -0,0 +1,101 @@
+// lcd_variant.cpp - LCD416.C built for the host with the defines given on
+// the command line (-DLCD_VARIANT=name plus the use_lcd_* options).
+#include "lcd_variant.h"
+#include "ccs_host.h"
+
+#include <cstring>
+
+#ifndef LCD_VARIANT
+#error Define LCD_VARIANT, see the Makefile
+#endif
+
+#define getenv(s) HOST_CLOCK
+namespace LCD_VARIANT {
+#include "lcd416_host.h"
+}
+#undef getenv
+
+#define LCD_CAT2(a, b) a##b
+#define LCD_CAT(a, b)  LCD_CAT2(a, b)
+#define LCD_STR2(a)    #a
+#define LCD_STR(a)     LCD_STR2(a)
+
+namespace {
+
+namespace drv = LCD_VARIANT;
+
+void setup()
+{
+    setup_adc_ports(AN0 | VSS_VDD);             // pc_usb.c, before lcd_init()
+#ifdef use_lcd_rw
+    drv::lcd_busy_ok = FALSE;
+    drv::lcd_busy_timeouts = 0;
+#endif
+#ifdef use_lcd_async
+    drv::lcd_q_head = drv::lcd_q_tail = 0;
+    drv::lcd_q_low = FALSE;
+    drv::lcd_q_wait = 0;
+    drv::lcd_q_dropped = 0;
+    host::set_timer2_isr(drv::lcd_async_isr);
+#endif
+}
+
+void init() { drv::lcd_init(); }
+void gotoxy(uint8_t x, uint8_t y) { drv::lcd_gotoxy(x, y); }
+void putc(char c) { drv::lcd_putc(c); }
+
+void puts(const char* s)
+{
+    char buf[128];
+    std::strncpy(buf, s, sizeof buf - 1);
+    buf[sizeof buf - 1] = 0;
+    drv::lcd_puts(buf);
+}
+void fb_gotoxy(uint8_t x, uint8_t y) { drv::lcd_fb_gotoxy(x, y); }
+void fb_putc(char c) { drv::lcd_fb_putc(c); }
+bool fb_dirty()
+{
+    for (unsigned r = 0; r < LCD_ROWS; ++r)
+        if (drv::lcd_fb_dirty[r])
+            return true;
+    return false;
+}
+
+// TareaLCD() calls lcd_flush() on every pass: the cells a full queue left
+// changed go out on a later one.
+void flush()
+{
+    drv::lcd_flush();
+    while (fb_dirty()) {
+        host_idle();
+        drv::lcd_flush();
+    }
+}
+
+void wait()
+{
+#ifdef use_lcd_async
+    drv::lcd_wait();
+#endif
+}
+
+unsigned dropped()
+{
+#ifdef use_lcd_async
+    return drv::lcd_q_dropped;
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+picusb::LcdDriver picusb::LCD_CAT(lcd_driver_, LCD_VARIANT)()
+{
+#ifdef use_lcd_8bit
+    return {LCD_STR(LCD_VARIANT), 0xF83, LCD_BUS_ADDR, 0xFF, true,
+#else
+    return {LCD_STR(LCD_VARIANT), 0xF83, 0xF83, 0xF0, true,
+#endif
+            setup, init, gotoxy, putc, puts, fb_gotoxy, fb_putc, flush, wait, dropped};
+}
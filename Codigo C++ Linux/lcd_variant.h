@@ -0,0 +1,39 @@
+// lcd_variant.h - one build of LCD416.C running on the host.
+//
+// lcd_variant.cpp is compiled once per driver configuration (see
+// LCD_VARIANTS in the Makefile), each time with its own defines and inside
+// its own namespace, and hands its entry points to lcd_bench through this
+// table.
+#pragma once
+
+#include <cstdint>
+
+namespace picusb {
+
+struct LcdDriver {
+    const char* name;
+    unsigned ctrl_port;      // RS on bit 0, E on bit 1, R/W on bit 2
+    unsigned data_port;      // DBn on bit n
+    uint8_t data_lines;      // DB lines wired, 0xF0 on a 4 bit bus
+    bool rw_wired;           // false: the LCD R/W pin is tied low
+    void (*setup)();         // reset the driver state, hook the interrupt
+    void (*init)();
+    void (*gotoxy)(uint8_t x, uint8_t y);
+    void (*putc)(char c);
+    void (*puts)(const char* s);
+    void (*fb_gotoxy)(uint8_t x, uint8_t y);
+    void (*fb_putc)(char c);
+    void (*flush)();
+    void (*wait)();          // until every queued byte reached the LCD
+    unsigned (*dropped)();   // bytes lost to a full queue with interrupts off
+};
+
+LcdDriver lcd_driver_delay();
+LcdDriver lcd_driver_busy();
+LcdDriver lcd_driver_async();
+LcdDriver lcd_driver_asyncq();
+LcdDriver lcd_driver_delay8();
+LcdDriver lcd_driver_busy8();
+LcdDriver lcd_driver_async8();
+
+} // namespace picusb
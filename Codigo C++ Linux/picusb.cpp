@@ -0,0 +1,637 @@
+// picusb.cpp - Device, the socket Transport and, with PICUSB_HAVE_LIBUSB,
+// the libusb one.  See picusb.h.
+#include "picusb.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef PICUSB_HAVE_LIBUSB
+#include <libusb.h>
+#endif
+
+namespace picusb {
+
+const char* status_name(Status s)
+{
+    switch (s) {
+    case Status::ok: return "ok";
+    case Status::timeout: return "timeout";
+    case Status::stall: return "stall";
+    case Status::no_device: return "no device";
+    case Status::cancelled: return "cancelled";
+    case Status::error: return "error";
+    }
+    return "?";
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Transfers a Transport has ended, handed to their done by events().
+class Finished {
+public:
+    void add(Request* r)
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        list_.push_back(r);
+    }
+
+    bool run()
+    {
+        std::vector<Request*> list;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            list.swap(list_);
+        }
+        for (Request* r : list)
+            r->done(*r);
+        return !list.empty();
+    }
+
+private:
+    std::mutex m_;
+    std::vector<Request*> list_;
+};
+
+// open_socket(): a transfer is split into packets (OUT) or asks for one
+// packet per token (IN, until it is full or a packet comes short).
+class SocketTransport : public Transport {
+public:
+    explicit SocketTransport(const std::string& path)
+    {
+        sockaddr_un a{};
+        a.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof a.sun_path)
+            throw std::runtime_error("bad socket path '" + path + "'");
+        std::memcpy(a.sun_path, path.data(), path.size());
+        if (path[0] == '@')
+            a.sun_path[0] = '\0';
+        const socklen_t len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+        fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&a), len) < 0) {
+            const std::string why = std::strerror(errno);
+            if (fd_ >= 0)
+                close(fd_);
+            throw std::runtime_error("cannot connect to " + path + ": " + why);
+        }
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wake_fd_ < 0) {
+            close(fd_);
+            throw std::runtime_error("eventfd failed");
+        }
+    }
+
+    ~SocketTransport() override
+    {
+        close(fd_);
+        close(wake_fd_);
+    }
+
+    void submit(Request* r) override
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        r->actual = 0;
+        r->status = Status::ok;
+        if (dead_) {
+            end(r, Status::no_device);
+            return;
+        }
+        Active& a = active_[r];
+        a.deadline = r->timeout_ms ? Clock::now() + std::chrono::milliseconds(r->timeout_ms)
+                                   : Clock::time_point::max();
+        if (r->ep != kEpOut) {
+            token(r);
+            return;
+        }
+        // as a bulk transfer: full packets, the last one short or empty,
+        // no zero length packet after a full one
+        unsigned at = 0;
+        do {
+            const unsigned n = std::min<unsigned>(kPacketSize, r->data.size() - at);
+            packet(wire::kOut, r, r->data.data() + at, n);
+            at += n;
+        } while (at < r->data.size() && !dead_);
+    }
+
+    void cancel(Request* r) override
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (active_.count(r))
+            end(r, Status::cancelled);
+    }
+
+    void events(unsigned timeout_ms) override
+    {
+        if (finished_.run())
+            return;
+        auto wait = std::chrono::milliseconds(timeout_ms);
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            const auto now = Clock::now();
+            for (const auto& a : active_)
+                if (a.second.deadline != Clock::time_point::max())
+                    wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                              a.second.deadline - now + std::chrono::microseconds(999)));
+        }
+        pollfd p[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        poll(p, 2, std::max<int>(0, static_cast<int>(wait.count())));
+        if (p[1].revents & POLLIN) {
+            uint64_t v;
+            if (read(wake_fd_, &v, sizeof v) < 0) {
+                // nothing to clear
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if (p[0].revents & POLLIN)
+                receive();
+            if (p[0].revents & (POLLHUP | POLLERR))
+                lost();
+            const auto now = Clock::now();
+            std::vector<Request*> late;
+            for (const auto& a : active_)
+                if (a.second.deadline <= now)
+                    late.push_back(a.first);
+            for (Request* r : late)
+                end(r, Status::timeout);
+        }
+        finished_.run();
+    }
+
+    void wake() override
+    {
+        const uint64_t v = 1;
+        if (write(wake_fd_, &v, sizeof v) < 0) {
+            // already pending
+        }
+    }
+
+private:
+    struct Active {
+        Clock::time_point deadline;
+        unsigned packets = 0;                // on the wire, not yet answered
+    };
+    struct Sent {
+        Request* r;
+        unsigned n;                          // OUT: bytes in the packet
+    };
+
+    // m_ held from here on.
+
+    bool message(uint8_t op, uint8_t ep, uint16_t seq, const uint8_t* p, unsigned n)
+    {
+        uint8_t m[wire::kHeader + kPacketSize];
+        m[0] = op;
+        m[1] = ep;
+        m[2] = static_cast<uint8_t>(seq);
+        m[3] = static_cast<uint8_t>(seq >> 8);
+        if (n)
+            std::memcpy(m + wire::kHeader, p, n);
+        return send(fd_, m, wire::kHeader + n, MSG_NOSIGNAL) >= 0;
+    }
+
+    void packet(uint8_t op, Request* r, const uint8_t* p, unsigned n)
+    {
+        const uint16_t seq = seq_++;
+        if (!message(op, r->ep, seq, p, n)) {
+            lost();
+            return;
+        }
+        sent_[seq] = {r, n};
+        ++active_[r].packets;
+    }
+
+    void token(Request* r)
+    {
+        if (r->actual >= r->data.size()) {
+            end(r, Status::ok);
+            return;
+        }
+        packet(wire::kIn, r, nullptr, 0);
+    }
+
+    void end(Request* r, Status s)
+    {
+        for (auto i = sent_.begin(); i != sent_.end();) {
+            if (i->second.r != r) {
+                ++i;
+                continue;
+            }
+            if (!dead_)
+                message(wire::kCancel, r->ep, i->first, nullptr, 0);
+            i = sent_.erase(i);
+        }
+        active_.erase(r);
+        r->status = s;
+        finished_.add(r);
+        wake();
+    }
+
+    void receive()
+    {
+        uint8_t m[wire::kHeader + kPacketSize + 1];
+        for (;;) {
+            const ssize_t n = recv(fd_, m, sizeof m, MSG_DONTWAIT);
+            if (n == 0) {
+                lost();
+                return;
+            }
+            if (n < 0)
+                return;
+            if (n < static_cast<ssize_t>(wire::kHeader))
+                continue;
+            const uint16_t seq = m[2] | m[3] << 8;
+            const auto i = sent_.find(seq);
+            if (i == sent_.end())
+                continue;                    // cancelled
+            Request* r = i->second.r;
+            const unsigned sent = i->second.n;
+            sent_.erase(i);
+            --active_[r].packets;
+            const unsigned len = static_cast<unsigned>(n) - wire::kHeader;
+            if (m[0] == wire::kStall) {
+                end(r, Status::stall);
+            } else if (m[0] == wire::kAck && r->ep == kEpOut) {
+                r->actual += sent;
+                if (active_[r].packets == 0)
+                    end(r, Status::ok);
+            } else if (m[0] == wire::kData && r->ep != kEpOut) {
+                const unsigned k = std::min<unsigned>(len, r->data.size() - r->actual);
+                std::memcpy(r->data.data() + r->actual, m + wire::kHeader, k);
+                r->actual += k;
+                if (len < kPacketSize)
+                    end(r, Status::ok);
+                else
+                    token(r);
+            } else {
+                end(r, Status::error);
+            }
+        }
+    }
+
+    void lost()
+    {
+        dead_ = true;
+        sent_.clear();
+        std::vector<Request*> all;
+        for (const auto& a : active_)
+            all.push_back(a.first);
+        for (Request* r : all)
+            end(r, Status::no_device);
+    }
+
+    int fd_ = -1;
+    int wake_fd_ = -1;
+    std::mutex m_;
+    uint16_t seq_ = 0;
+    bool dead_ = false;
+    std::map<Request*, Active> active_;
+    std::map<uint16_t, Sent> sent_;
+    Finished finished_;
+};
+
+#ifdef PICUSB_HAVE_LIBUSB
+// open_usb(): a libusb_transfer per transfer, freed when it ends.  libusb
+// splits it into packets and keeps the order of each endpoint.
+class UsbTransport : public Transport {
+public:
+    UsbTransport(uint16_t vid, uint16_t pid)
+    {
+        int e = libusb_init(&ctx_);
+        if (e < 0)
+            throw std::runtime_error(std::string("libusb_init: ") + libusb_error_name(e));
+        h_ = libusb_open_device_with_vid_pid(ctx_, vid, pid);
+        if (!h_) {
+            libusb_exit(ctx_);
+            throw std::runtime_error("no PicUSB on the bus (or no permission to open it)");
+        }
+        libusb_set_auto_detach_kernel_driver(h_, 1);
+        e = libusb_claim_interface(h_, kInterface);
+        if (e < 0) {
+            libusb_close(h_);
+            libusb_exit(ctx_);
+            throw std::runtime_error(std::string("libusb_claim_interface: ") + libusb_error_name(e));
+        }
+    }
+
+    ~UsbTransport() override
+    {
+        libusb_release_interface(h_, kInterface);
+        libusb_close(h_);
+        libusb_exit(ctx_);
+    }
+
+    void submit(Request* r) override
+    {
+        r->actual = 0;
+        r->status = Status::ok;
+        Slot* slot = new Slot{this, r, libusb_alloc_transfer(0)};
+        if (!slot->x) {
+            delete slot;
+            failed(r, Status::error);
+            return;
+        }
+        libusb_fill_bulk_transfer(slot->x, h_, r->ep, r->data.data(), static_cast<int>(r->data.size()),
+                                  &UsbTransport::callback, slot, r->timeout_ms);
+        std::lock_guard<std::mutex> lock(m_);
+        r->priv = slot;
+        const int e = libusb_submit_transfer(slot->x);
+        if (e < 0) {
+            r->priv = nullptr;
+            libusb_free_transfer(slot->x);
+            delete slot;
+            failed(r, e == LIBUSB_ERROR_NO_DEVICE ? Status::no_device : Status::error);
+        }
+    }
+
+    // The transfer stays with r until its callback, which takes m_ first,
+    // so it cannot be freed under libusb_cancel_transfer().
+    void cancel(Request* r) override
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (r->priv)
+            libusb_cancel_transfer(static_cast<Slot*>(r->priv)->x);
+    }
+
+    void events(unsigned timeout_ms) override
+    {
+        if (finished_.run())
+            return;
+        timeval tv{static_cast<time_t>(timeout_ms / 1000),
+                   static_cast<suseconds_t>(timeout_ms % 1000 * 1000)};
+        libusb_handle_events_timeout_completed(ctx_, &tv, nullptr);
+        finished_.run();
+    }
+
+    void wake() override { libusb_interrupt_event_handler(ctx_); }
+
+private:
+    struct Slot {
+        UsbTransport* t;
+        Request* r;
+        libusb_transfer* x;
+    };
+
+    void failed(Request* r, Status s)
+    {
+        r->status = s;
+        finished_.add(r);
+        wake();
+    }
+
+    // Runs inside libusb_handle_events_timeout_completed(), from events().
+    static void LIBUSB_CALL callback(libusb_transfer* x)
+    {
+        Slot* slot = static_cast<Slot*>(x->user_data);
+        Request* r = slot->r;
+        {
+            std::lock_guard<std::mutex> lock(slot->t->m_);
+            r->priv = nullptr;
+        }
+        switch (x->status) {
+        case LIBUSB_TRANSFER_COMPLETED: r->status = Status::ok; break;
+        case LIBUSB_TRANSFER_TIMED_OUT: r->status = Status::timeout; break;
+        case LIBUSB_TRANSFER_STALL: r->status = Status::stall; break;
+        case LIBUSB_TRANSFER_NO_DEVICE: r->status = Status::no_device; break;
+        case LIBUSB_TRANSFER_CANCELLED: r->status = Status::cancelled; break;
+        default: r->status = Status::error; break;
+        }
+        r->actual = static_cast<unsigned>(x->actual_length);
+        libusb_free_transfer(x);
+        delete slot;
+        r->done(*r);
+    }
+
+    libusb_context* ctx_ = nullptr;
+    libusb_device_handle* h_ = nullptr;
+    std::mutex m_;
+    Finished finished_;
+};
+#endif
+
+} // namespace
+
+#ifdef PICUSB_HAVE_LIBUSB
+std::unique_ptr<Transport> open_usb(uint16_t vid, uint16_t pid)
+{
+    return std::make_unique<UsbTransport>(vid, pid);
+}
+#endif
+
+std::unique_ptr<Transport> open_socket(const std::string& path)
+{
+    return std::make_unique<SocketTransport>(path);
+}
+
+Device::Device(std::unique_ptr<Transport> t, unsigned depth, unsigned timeout_ms)
+    : t_(std::move(t)), depth_(std::max(1u, depth)), timeout_ms_(timeout_ms)
+{
+    thread_ = std::thread([this] { run(); });
+}
+
+Device::~Device()
+{
+    std::deque<std::unique_ptr<Job>> dropped;
+    {
+        std::unique_lock<std::mutex> lock(m_);
+        stopping_ = true;
+        reading_ = false;
+        dropped.swap(queued_);
+        for (const auto& j : busy_)
+            t_->cancel(j.get());
+        idle_.wait(lock, [this] { return busy_.empty(); });
+        quit_ = true;
+    }
+    t_->wake();
+    thread_.join();
+    for (const auto& j : dropped) {
+        j->status = Status::cancelled;
+        if (j->then)
+            j->then(*j);
+    }
+}
+
+void Device::run()
+{
+    for (;;) {
+        t_->events(100);
+        std::lock_guard<std::mutex> lock(m_);
+        dead_.clear();
+        if (quit_)
+            return;
+    }
+}
+
+void Device::start(std::unique_ptr<Job> j)
+{
+    Job* p = j.get();
+    p->done = [this](Request& r) { ended(r); };
+    if (p->ep == kEpOut)
+        stats_.max_out = std::max(stats_.max_out, ++out_);
+    else
+        stats_.max_in = std::max(stats_.max_in, ++in_);
+    busy_.push_back(std::move(j));
+    t_->submit(p);
+}
+
+void Device::pump()
+{
+    while (!stopping_ && out_ < depth_ && !queued_.empty()) {
+        std::unique_ptr<Job> j = std::move(queued_.front());
+        queued_.pop_front();
+        start(std::move(j));
+    }
+}
+
+// Out of busy_; freed once the Transport's events() has returned.
+void Device::retire(Job& j)
+{
+    const auto i = std::find_if(busy_.begin(), busy_.end(),
+                                [&](const std::unique_ptr<Job>& b) { return b.get() == &j; });
+    dead_.push_back(std::move(*i));
+    busy_.erase(i);
+    --(j.ep == kEpOut ? out_ : in_);
+    idle_.notify_all();
+}
+
+void Device::ended(Request& r)
+{
+    Job& j = static_cast<Job&>(r);
+    std::function<void(Status, const uint8_t*, unsigned)> on_packet;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (r.status != Status::ok && r.status != Status::cancelled)
+            ++stats_.failed;
+        if (r.ep == kEpOut)
+            ++stats_.writes;
+        else if (r.status == Status::ok)
+            ++stats_.reads;
+        if (j.stream) {
+            if (r.status == Status::ok) {
+                on_packet = on_packet_;
+            } else if (r.status != Status::cancelled && reading_) {
+                // the first error ends reading; the others would repeat it
+                reading_ = false;
+                for (const auto& b : busy_)
+                    if (b->stream && b.get() != &j)
+                        t_->cancel(b.get());
+                on_packet = on_packet_;
+            }
+        } else {
+            retire(j);
+            pump();
+            ++calling_;
+        }
+    }
+    if (!j.stream) {
+        if (j.then)
+            j.then(r);
+        std::lock_guard<std::mutex> lock(m_);
+        --calling_;
+        idle_.notify_all();
+        return;
+    }
+    if (on_packet)
+        on_packet(r.status, r.data.data(), r.actual);
+    std::lock_guard<std::mutex> lock(m_);
+    if (reading_ && r.status == Status::ok)
+        t_->submit(&r);                      // same place in busy_
+    else
+        retire(j);
+}
+
+void Device::write(std::vector<uint8_t> data, std::function<void(Status)> done)
+{
+    auto j = std::make_unique<Job>();
+    j->ep = kEpOut;
+    j->data = std::move(data);
+    j->timeout_ms = timeout_ms_;
+    if (done)
+        j->then = [done](Request& r) { done(r.status); };
+    std::lock_guard<std::mutex> lock(m_);
+    queued_.push_back(std::move(j));
+    pump();
+}
+
+std::future<Status> Device::write(std::vector<uint8_t> data)
+{
+    auto p = std::make_shared<std::promise<Status>>();
+    std::future<Status> f = p->get_future();
+    write(std::move(data), [p](Status s) { p->set_value(s); });
+    return f;
+}
+
+void Device::flush()
+{
+    std::unique_lock<std::mutex> lock(m_);
+    idle_.wait(lock, [this] { return queued_.empty() && out_ == 0 && calling_ == 0; });
+}
+
+void Device::start_reading(std::function<void(Status, const uint8_t*, unsigned)> on_packet)
+{
+    std::unique_lock<std::mutex> lock(m_);
+    if (reading_)
+        throw std::logic_error("start_reading() while reading");
+    // the transfers an error cancelled, still ending
+    idle_.wait(lock, [this] {
+        return std::none_of(busy_.begin(), busy_.end(),
+                            [](const std::unique_ptr<Job>& b) { return b->stream; });
+    });
+    if (in_)
+        throw std::logic_error("start_reading() while read() is on");
+    on_packet_ = std::move(on_packet);
+    reading_ = true;
+    for (unsigned i = 0; i < depth_; ++i) {
+        auto j = std::make_unique<Job>();
+        j->ep = kEpIn;
+        j->data.resize(kPacketSize);
+        j->stream = true;
+        start(std::move(j));
+    }
+}
+
+void Device::stop_reading()
+{
+    std::unique_lock<std::mutex> lock(m_);
+    reading_ = false;
+    for (const auto& j : busy_)
+        if (j->stream)
+            t_->cancel(j.get());
+    idle_.wait(lock, [this] { return in_ == 0; });
+}
+
+std::future<Device::Packet> Device::read(unsigned timeout_ms)
+{
+    auto p = std::make_shared<std::promise<Packet>>();
+    std::future<Packet> f = p->get_future();
+    auto j = std::make_unique<Job>();
+    j->ep = kEpIn;
+    j->data.resize(kPacketSize);
+    j->timeout_ms = timeout_ms;
+    j->then = [p](Request& r) {
+        p->set_value({r.status, std::vector<uint8_t>(r.data.begin(), r.data.begin() + r.actual)});
+    };
+    std::lock_guard<std::mutex> lock(m_);
+    if (reading_)
+        throw std::logic_error("read() while start_reading() is on");
+    start(std::move(j));
+    return f;
+}
+
+Device::Stats Device::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return stats_;
+}
+
+} // namespace picusb
@@ -0,0 +1,181 @@
+// picusb.h - the PicUSB from a Linux program, the part of Frame.java that
+// iface.QWrite() of jpicusb.dll does, without opening and closing the
+// device for every write.
+//
+// A Transport is one opened device: it starts bulk transfers on endpoint 1
+// and reports each one's end from events().  open_usb() finds the board by
+// its VID and PID (header.h) through libusb's asynchronous API; it is only
+// there when built with PICUSB_HAVE_LIBUSB (the Makefile sets it when
+// pkg-config knows libusb-1.0).  open_socket() connects to an emulated
+// device instead (usb_emu.h), one message per USB packet, so the library
+// is tested without the board.
+//
+// A Device keeps a Transport open for as long as it lives and runs its
+// events() in a thread of its own.  Up to depth transfers per endpoint are
+// on the bus at once: write() queues an OUT transfer and returns at once,
+// its completion comes to a callback or a future; start_reading() keeps
+// depth IN transfers waiting so every packet the firmware sends is taken
+// as it comes.  Callbacks run in the event thread, in the order the
+// transfers end, which for one endpoint is the order they were started.
+//
+//   picusb::Device dev(picusb::open_usb());
+//   dev.write({88, valor}).get();               // TIPO_COMANDO, as send_command()
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace picusb {
+
+constexpr uint16_t kVid = 0x04D8;            // header.h, USB_DEVICE_DESC
+constexpr uint16_t kPid = 0x000B;
+constexpr unsigned kInterface = 0;
+constexpr uint8_t kEpOut = 0x01;             // USB_EP1_RX_ENABLE, bulk
+constexpr uint8_t kEpIn = 0x81;              // USB_EP1_TX_ENABLE, bulk
+constexpr unsigned kPacketSize = 32;         // USB_EP1_TX_SIZE, USB_EP1_RX_SIZE
+
+enum class Status { ok, timeout, stall, no_device, cancelled, error };
+
+const char* status_name(Status s);
+
+// One bulk transfer.  OUT sends data; IN fills data up to its size and
+// sets actual.  The Transport owns it from submit() until done runs.
+struct Request {
+    uint8_t ep = kEpOut;
+    std::vector<uint8_t> data;
+    unsigned actual = 0;
+    unsigned timeout_ms = 0;                 // 0: none
+    Status status = Status::ok;
+    std::function<void(Request&)> done;
+    void* priv = nullptr;                    // the Transport's
+};
+
+class Transport {
+public:
+    virtual ~Transport() = default;
+    // Starts r; may be called from any thread.  A transfer that cannot
+    // start ends with its error from events() like any other.
+    virtual void submit(Request* r) = 0;
+    // Ends r early with Status::cancelled (as reported by events()); what
+    // it had already moved stays in actual.
+    virtual void cancel(Request* r) = 0;
+    // Waits up to timeout_ms for transfers to end and runs their done,
+    // after which the Transport no longer touches them.  One thread only.
+    virtual void events(unsigned timeout_ms) = 0;
+    // Makes a waiting events() return.
+    virtual void wake() = 0;
+};
+
+#ifdef PICUSB_HAVE_LIBUSB
+// The first PicUSB on the bus, its interface claimed (the kernel driver
+// detached while it is open).  Throws std::runtime_error if there is none.
+std::unique_ptr<Transport> open_usb(uint16_t vid = kVid, uint16_t pid = kPid);
+#endif
+
+// The emulated device listening at path (usb_emu.h); a leading '@' is the
+// abstract namespace.  Throws std::runtime_error if nobody listens.
+std::unique_ptr<Transport> open_socket(const std::string& path);
+
+// Messages of open_socket(), a SOCK_SEQPACKET socket: one per USB packet
+// or token, op, endpoint, sequence number (2 bytes, the least significant
+// first) and the data.  The device answers the packets and tokens of an
+// endpoint in the order they came, each when it is ready: an OUT packet
+// it has no room for waits, as the NAKs of the bus.
+namespace wire {
+constexpr uint8_t kOut = 1;                  // host: OUT packet
+constexpr uint8_t kIn = 2;                   // host: IN token, no data
+constexpr uint8_t kAck = 3;                  // device: took OUT packet seq
+constexpr uint8_t kData = 4;                 // device: the IN packet of token seq
+constexpr uint8_t kCancel = 5;               // host: forget packet or token seq
+constexpr uint8_t kStall = 6;                // device: endpoint halted at seq
+constexpr unsigned kHeader = 4;
+} // namespace wire
+
+class Device {
+public:
+    struct Stats {
+        unsigned writes = 0;                 // OUT transfers ended
+        unsigned reads = 0;                  // IN transfers ended with data
+        unsigned failed = 0;                 // ended other than ok or cancelled
+        unsigned max_out = 0;                // most OUT transfers on the bus at once
+        unsigned max_in = 0;
+    };
+
+    // Takes t, at most depth transfers per endpoint on the bus; writes end
+    // with Status::timeout after timeout_ms (QWrite's dwMilliseconds).
+    explicit Device(std::unique_ptr<Transport> t, unsigned depth = 4, unsigned timeout_ms = 1000);
+    // Cancels what is still on the bus and waits for it.
+    ~Device();
+
+    Device(const Device&) = delete;
+    Device& operator=(const Device&) = delete;
+
+    // One OUT transfer with data; done runs in the event thread.  Writes
+    // go out in the order they are made.
+    void write(std::vector<uint8_t> data, std::function<void(Status)> done);
+    std::future<Status> write(std::vector<uint8_t> data);
+
+    // Waits until every write has ended and its callback has returned.
+    // Not from a callback.
+    void flush();
+
+    // Calls on_packet with every IN packet from now on (Status::ok), or
+    // once with the first error that ended an IN transfer, after which
+    // reading stops: the other IN transfers are cancelled and
+    // start_reading() may be called again.  Not from a callback.
+    void start_reading(std::function<void(Status, const uint8_t*, unsigned)> on_packet);
+    // Cancels the waiting IN transfers and waits for them; a packet the
+    // firmware sends while they end can be lost, as on the bus.  Not from
+    // a callback.
+    void stop_reading();
+
+    struct Packet {
+        Status status;
+        std::vector<uint8_t> data;
+    };
+    // One IN packet, or the error after timeout_ms (0: none).  Not while
+    // start_reading() is on.
+    std::future<Packet> read(unsigned timeout_ms);
+
+    Stats stats() const;
+
+private:
+    struct Job : Request {
+        bool stream = false;                 // start_reading()'s, submitted again
+        std::function<void(Request&)> then;  // write() and read()'s
+    };
+
+    void run();
+    void start(std::unique_ptr<Job> j);      // m_ held
+    void pump();                             // starts queued writes; m_ held
+    void retire(Job& j);                     // m_ held
+    void ended(Request& r);
+
+    std::unique_ptr<Transport> t_;
+    const unsigned depth_;
+    const unsigned timeout_ms_;
+
+    mutable std::mutex m_;
+    std::condition_variable idle_;
+    std::deque<std::unique_ptr<Job>> queued_;        // writes not yet started
+    std::vector<std::unique_ptr<Job>> busy_;         // on the bus, both endpoints
+    std::vector<std::unique_ptr<Job>> dead_;         // ended, freed by the event thread
+    unsigned out_ = 0, in_ = 0;                      // busy_ of each endpoint
+    unsigned calling_ = 0;                           // then of ended jobs running
+    std::function<void(Status, const uint8_t*, unsigned)> on_packet_;
+    bool reading_ = false;
+    bool stopping_ = false;
+    bool quit_ = false;
+    Stats stats_;
+    std::thread thread_;
+};
+
+} // namespace picusb
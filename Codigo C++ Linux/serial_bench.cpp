@@ -0,0 +1,554 @@
+// serial_bench - runs the serial modules of Envio and Recibe (uart_tx.c,
+// uart_rx.c, frame.c, uart_baud.h) on two emulated PICs joined by a
+// pseudo-terminal pair through the EUSART model of eusart.h, and reports
+// throughput, latency and loss per protocol, message size, baud rate,
+// offered load and injected line error rate.  No two PICs or Proteus
+// needed; the exit status is 1 if any check fails, so "make check" can
+// guard changes to the link.
+//
+//   serial_bench
+//
+// The sender does what TareaUART does, once per main loop pass: queue the
+// next message (raw: uart_tx_write(), frame: frame_send()) if there is
+// room.  The receiver does what TareaSalida does: take every byte or frame
+// that is waiting; "isr" rows instead take each frame inside #int_RDA as
+// soon as it is checked, as Recibe's SalidaTrama() does (frame_rx_take).  A main loop pass costs 100 instruction cycles; the
+// interrupts and register accesses of the modules come on top, as in
+// lcd_bench.  Each PIC has its own modelled clock and the one behind runs
+// next, so the two stay within one pass of each other.
+//
+// Messages carry a sequence number (the value itself for 1 byte messages)
+// so the receiver can tell lost, out of order and corrupted ones apart.
+// Columns: messages sent, delivered intact, lost, delivered wrong (not
+// caught by the protocol); payload bytes/s and their share of the line
+// (baud / 10); latency from the send call to the receiver taking the
+// message; receiver FERR/OERR bytes and frames rejected (CRC, length);
+// errors injected on the line; time each PIC spent in interrupts.
+//
+// Then rows send at one rate to a receiver built for another, which must
+// see framing errors; raw bytes that happen to sample right still get
+// through, frames must not.
+//
+// The last rows slow the receiver down to one byte every kSlowPasses main
+// loop passes at 1 Mbaud, a third of the line: "slow" without flow
+// control, where its queue must overflow, and "rts" with the RTS/CTS wire
+// of uart_rx.c and uart_tx.c (UART_RX_FLOW, UART_TX_FLOW), where the
+// sender must wait instead.  "fslow" and "frts" do the same with frames,
+// one taken every kSlowPasses passes per byte of the frame on the wire:
+// without flow control frames must be dropped (frame_rx_dropped), with it
+// none may be.
+//
+// Checks: with no injected errors nothing may be lost or wrong (but for
+// the "slow" rows), with errors the framed protocol may lose messages but
+// never deliver a wrong one, and no frame may get through a baud rate
+// mismatch.
+//
+// A second table runs the link.c negotiation from the 115200 base rate:
+// the initiator does what Envio's TareaUART does (abd_sync_poll() with
+// autobaud.c, link_poll(), then one value frame whenever frame_send()
+// takes it), the responder what Recibe's main and TareaSalida do.  "up"
+// must end at 1000000 on both sides, "max" at the 250000 of a responder
+// that offers no more, "old" at the base rate after the initiator's
+// tries go unanswered by a responder without link.c, "lostok" at 1000000
+// although the responder's first LINK_OK is lost (Line::lose()), "reset"
+// at 1000000 again after the initiator is reset once up, the responder
+// falling back on the errors its CAPS makes at the wrong rate.  "abd"
+// and "abdreset" do the same with autobaud.c, the responder built for
+// 9600 and measuring the initiator's 115200; the initiator must get its
+// lock time in the CAPS answer.  Columns: final rate of each side, their
+// link_fallbacks, time from the (last) start to link_poll() returning
+// TRUE, the lock time reported, and the value frames sent, delivered,
+// lost and wrong.  None may be wrong, and none lost but at a reset.
+#include "ccs_host.h"
+#include "eusart.h"
+#include "serial_node.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using picusb::Eusart;
+using picusb::PtyLink;
+using picusb::SerialCounters;
+using picusb::SerialNode;
+
+constexpr uint64_t kCycleNs = 4000000000ULL / HOST_CLOCK;
+constexpr uint64_t kLoopNs = 100 * kCycleNs;
+constexpr unsigned kWindowBytes = 2000;      // measured time, in byte times of the line
+constexpr unsigned kDrainBytes = 200;        // then the sender stops and the line empties
+constexpr uint8_t kFrameValue = 0x01;        // FRAME_T_VALUE in frame.c
+constexpr unsigned kSlowPasses = 4;
+constexpr uint8_t kFrameLink = 0x02;         // FRAME_T_LINK
+constexpr unsigned kLinkUp = 6;              // LINK_UP in link.c
+constexpr unsigned kLinkConfirm = 5;         // LINK_CONFIRM
+constexpr unsigned kLinkOkWire = 7;          // a LINK_OK frame on the wire
+constexpr uint64_t kLinkNs = 300000000;      // each link row
+constexpr uint64_t kResetNs = 150000000;     // the initiator resets
+
+struct Link {
+    SerialNode tx, rxraw, rxframe;
+};
+
+struct Case {
+    bool framed;
+    bool isr;               // frames taken inside #int_RDA (frame_rx_take)
+    unsigned size;
+    unsigned load;          // percent of the line, 0: as fast as the queue takes them
+    double errors;          // per byte on the line
+    bool mismatch;          // receiver built for another baud rate
+    unsigned slow = 0;      // receiver takes one byte every slow passes, 0: all waiting
+    bool flow = false;      // RTS/CTS nodes
+};
+
+struct Result {
+    unsigned sent = 0, good = 0, lost = 0, bad = 0;
+    uint64_t payload = 0;   // good payload bytes delivered inside the window
+    double lat_sum = 0;
+    uint64_t lat_max = 0;
+    SerialCounters rx;
+    unsigned injected = 0;
+    unsigned tx_held = 0;
+    double tx_isr = 0, rx_isr = 0;
+    std::string why;
+};
+
+void message(uint32_t seq, unsigned size, uint8_t* p)
+{
+    p[0] = static_cast<uint8_t>(seq);
+    if (size > 1)
+        p[1] = static_cast<uint8_t>(seq >> 8);
+    for (unsigned i = 2; i < size; ++i)
+        p[i] = static_cast<uint8_t>(seq + i);
+}
+
+class Receiver {
+public:
+    Receiver(const Case& c, const std::vector<uint64_t>& sent_at, uint64_t window, Result& r)
+        : c_(c), sent_at_(sent_at), window_(window), r_(r) {}
+
+    void deliver(const uint8_t* p, unsigned n, uint64_t now)
+    {
+        if (n != c_.size) {
+            ++r_.bad;
+            return;
+        }
+        // sequence number from the low bits, looking a little way ahead
+        const uint32_t ahead = c_.size == 1 ? static_cast<uint8_t>(p[0] - expected_)
+                                            : static_cast<uint16_t>((p[0] | p[1] << 8) - expected_);
+        const uint32_t s = expected_ + ahead;
+        uint8_t want[256];
+        message(s, n, want);
+        if (ahead >= 16 || s >= sent_at_.size() || !std::equal(p, p + n, want)) {
+            ++r_.bad;
+            ++expected_;            // it took the place of the one expected
+            return;
+        }
+        r_.lost += ahead;
+        expected_ = s + 1;
+        ++r_.good;
+        if (now <= window_)
+            r_.payload += n;
+        const uint64_t lat = now - sent_at_[s];
+        r_.lat_sum += lat;
+        r_.lat_max = std::max(r_.lat_max, lat);
+    }
+
+    uint32_t expected() const { return expected_; }
+
+private:
+    const Case& c_;
+    const std::vector<uint64_t>& sent_at_;
+    uint64_t window_;
+    Result& r_;
+    uint32_t expected_ = 0;
+};
+
+Result run(const SerialNode& tx, const SerialNode& rx, const Case& c, host::Cpu* cpu_tx,
+           host::Cpu* cpu_rx)
+{
+    Result r;
+    const double byte_ns = 10e9 / tx.baud_actual;
+    const uint64_t window = static_cast<uint64_t>(kWindowBytes * byte_ns);
+    // a slowed receiver also has both queues to empty at its own pace
+    const uint64_t stop = window + static_cast<uint64_t>(kDrainBytes * byte_ns) + 2000000 +
+                          c.slow * 128 * kLoopNs;
+    const unsigned wire = c.framed ? c.size + 6 : c.size;   // COBS code, type, len, CRC, 0x00
+    const uint64_t interval = c.load ? static_cast<uint64_t>(wire * byte_ns * 100 / c.load) : 0;
+
+    PtyLink pty;
+    pty.forward().set_errors(c.errors, 1);
+    Eusart tx_uart(HOST_CLOCK, &pty.forward(), &pty.back());
+    Eusart rx_uart(HOST_CLOCK, &pty.back(), &pty.forward());
+
+    std::vector<uint64_t> sent_at;
+    Receiver receiver(c, sent_at, window, r);
+
+    if (c.isr)
+        rx.set_take([&](uint8_t type, const uint8_t* p, uint8_t n) {
+            if (type != kFrameValue)
+                return false;
+            receiver.deliver(p, n, host_now_ns);
+            return true;
+        });
+
+    try {
+        host::select(cpu_tx);
+        host::reset();
+        host::attach(&tx_uart);
+        tx.setup();
+        uint64_t now_tx = host_now_ns;
+        host::select(cpu_rx);
+        host::reset();
+        host::attach(&rx_uart);
+        rx.setup();
+        uint64_t now_rx = host_now_ns;
+
+        uint64_t next_send = 0;
+        unsigned passes_rx = 0;
+        while (now_tx < stop || now_rx < stop) {
+            if (now_tx <= now_rx) {
+                host::select(cpu_tx);
+                if (host_now_ns < window && host_now_ns >= next_send) {
+                    uint8_t p[256];
+                    message(static_cast<uint32_t>(sent_at.size()), c.size, p);
+                    const uint64_t t = host_now_ns;
+                    const bool ok = c.framed ? tx.send(kFrameValue, p, c.size) : tx.put(p, c.size);
+                    if (ok) {
+                        sent_at.push_back(t);
+                        next_send += interval;
+                    }
+                }
+                host_delay_ns(kLoopNs);
+                now_tx = host_now_ns;
+            } else {
+                host::select(cpu_rx);
+                uint8_t p[256];
+                if (c.framed) {
+                    uint8_t type, n;
+                    if (!c.slow || ++passes_rx % c.slow == 0)
+                        while (rx.receive(&type, p, &n)) {
+                            if (type == kFrameValue)
+                                receiver.deliver(p, n, host_now_ns);
+                            if (c.slow)
+                                break;
+                        }
+                } else if (!c.slow || ++passes_rx % c.slow == 0) {
+                    for (int b; (b = rx.get()) >= 0;) {
+                        p[0] = static_cast<uint8_t>(b);
+                        receiver.deliver(p, 1, host_now_ns);
+                        if (c.slow)
+                            break;
+                    }
+                }
+                host_delay_ns(kLoopNs);
+                now_rx = host_now_ns;
+            }
+        }
+        host::select(cpu_tx);
+        r.tx_isr = 100.0 * host::isr_ns() / host_now_ns;
+        host::select(cpu_rx);
+        r.rx_isr = 100.0 * host::isr_ns() / host_now_ns;
+    } catch (const std::exception& e) {
+        r.why = e.what();
+    }
+    host::attach(nullptr);
+    host::select(cpu_tx);
+    host::attach(nullptr);
+    host::select(nullptr);
+    if (c.isr)
+        rx.set_take(nullptr);
+
+    r.sent = static_cast<unsigned>(sent_at.size());
+    r.lost += r.sent - std::min<uint32_t>(receiver.expected(), r.sent);   // never arrived
+    r.rx = rx.counters();
+    r.tx_held = tx.counters().tx_held;
+    const picusb::Line::Stats& ls = pty.forward().stats();
+    r.injected = ls.flipped + ls.stop_low + ls.lost;
+
+    if (r.why.empty() && r.sent == 0)
+        r.why = "nothing sent";
+    if (r.why.empty() && c.mismatch && !r.rx.rx_framing)
+        r.why = "no framing errors at the wrong baud rate";
+    if (r.why.empty() && c.mismatch && c.framed && r.good)
+        r.why = "frames got through at the wrong baud rate";
+    if (r.why.empty() && c.slow && !c.flow && !(c.framed ? r.rx.dropped_frames : r.rx.rx_dropped))
+        r.why = "the slowed receiver kept up";
+    if (r.why.empty() && c.slow && c.flow && (r.rx.dropped_frames || r.rx.rx_dropped))
+        r.why = "dropped with flow control";
+    if (r.why.empty() && c.slow && c.flow && !r.tx_held)
+        r.why = "CTS never stopped the sender";
+    if (r.why.empty() && c.errors == 0 && !c.mismatch && (r.lost || r.bad) &&
+        !(c.slow && !c.flow))
+        r.why = "lost or wrong messages on a clean line";
+    if (r.why.empty() && c.framed && r.bad)
+        r.why = "wrong frames delivered";
+    return r;
+}
+
+void print(const SerialNode& tx, const SerialNode& rx, const Case& c, const Result& r)
+{
+    const double window_s = kWindowBytes * 10.0 / tx.baud_actual;
+    const double bps = r.payload / window_s;
+    char baud[24], load[8];
+    std::snprintf(baud, sizeof baud, c.mismatch ? "%u>%u" : "%u", tx.baud, rx.baud);
+    std::snprintf(load, sizeof load, c.load ? "%u%%" : "max", c.load);
+    std::printf("%-5s %4u %15s %4s %6g  %6u %6u %5u %5u  %8.0f %5.1f  %9.1f %9.1f  "
+                "%4u %4u %4u %4u  %5.1f%% %5.1f%%  %s\n",
+                c.slow ? (c.framed ? (c.flow ? "frts" : "fslow") : (c.flow ? "rts" : "slow"))
+                       : c.isr ? "isr" : c.framed ? "frame" : "raw",
+                c.size, baud, load, c.errors, r.sent, r.good, r.lost,
+                r.bad, bps, 100.0 * bps / (tx.baud_actual / 10.0),
+                r.good ? r.lat_sum / r.good / 1000.0 : 0.0, r.lat_max / 1000.0, r.rx.rx_framing,
+                r.rx.rx_overruns, r.rx.crc_errors + r.rx.bad_frames, r.injected, r.tx_isr, r.rx_isr,
+                r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+}
+
+struct LinkCase {
+    const char* name;
+    const SerialNode* tx;   // initiator
+    const SerialNode* rx;   // responder, or an rxframe node without link.c
+    bool abd;               // autobaud.c first
+    bool lose_ok;           // the responder's first LINK_OK is lost
+    bool reset;             // the initiator resets at kResetNs
+    unsigned want;          // rate both must end at
+};
+
+struct LinkResult {
+    picusb::SerialLink tx, rx;
+    uint64_t up_ns = 0;     // link_poll() TRUE, from the (last) start
+    unsigned sent = 0, good = 0, lost = 0, bad = 0;
+    std::string why;
+};
+
+LinkResult run_link(const LinkCase& k, host::Cpu* cpu_tx, host::Cpu* cpu_rx)
+{
+    LinkResult r;
+    const SerialNode& tx = *k.tx;
+    const SerialNode& rx = *k.rx;
+    Result values;
+    const Case c{true, false, 1, 0, 0, false};
+    std::vector<uint64_t> sent_at;
+    Receiver receiver(c, sent_at, kLinkNs, values);
+
+    PtyLink pty;
+    auto tx_uart = std::make_unique<Eusart>(HOST_CLOCK, &pty.forward(), &pty.back());
+    Eusart rx_uart(HOST_CLOCK, &pty.back(), &pty.forward());
+    bool rx_linked = false;  // Recibe's main: link_init() once autobaud.c locked
+    bool reset = false, lost = false;
+    uint64_t start = 0;
+    unsigned good_at_reset = 0;
+
+    try {
+        host::select(cpu_tx);
+        host::reset();
+        host::attach(tx_uart.get());
+        tx.setup();
+        tx.link_init();
+        uint64_t now_tx = host_now_ns;
+        host::select(cpu_rx);
+        host::reset();
+        host::attach(&rx_uart);
+        rx.setup();
+        if (k.abd) {
+            rx.abd_start();
+        } else if (rx.link_init) {
+            rx.link_init();
+            rx_linked = true;
+        }
+        uint64_t now_rx = host_now_ns;
+
+        while (now_tx < kLinkNs || now_rx < kLinkNs) {
+            if (now_tx <= now_rx) {
+                host::select(cpu_tx);
+                if (k.reset && !reset && r.up_ns && host_now_ns >= kResetNs) {
+                    const uint64_t t = host_now_ns;
+                    host::reset();
+                    host_now_ns = t;            // the reset button: the line keeps its time
+                    tx_uart = std::make_unique<Eusart>(HOST_CLOCK, &pty.forward(), &pty.back());
+                    host::attach(tx_uart.get());
+                    tx.setup();
+                    tx.link_init();
+                    reset = true;
+                    start = t;
+                    r.up_ns = 0;
+                    good_at_reset = values.good;
+                }
+                if ((!k.abd || tx.abd_poll()) && tx.link_poll()) {   // TareaUART
+                    if (!r.up_ns)
+                        r.up_ns = host_now_ns - start;
+                    uint8_t p[1];
+                    message(static_cast<uint32_t>(sent_at.size()), 1, p);
+                    if (host_now_ns < kLinkNs - 5000000 && tx.send(kFrameValue, p, 1))
+                        sent_at.push_back(host_now_ns);
+                }
+                if (k.lose_ok && !lost && tx.link().state == kLinkConfirm) {
+                    pty.back().lose(kLinkOkWire);
+                    lost = true;
+                }
+                host_delay_ns(kLoopNs);
+                now_tx = host_now_ns;
+            } else {
+                host::select(cpu_rx);
+                if (k.abd && !rx_linked) {
+                    if (rx.abd_poll()) {
+                        rx.link_init();
+                        rx_linked = true;
+                    }
+                } else if (!k.abd || rx.abd_poll()) {             // TareaSalida
+                    uint8_t type, n, p[256];
+                    while (rx.receive(&type, p, &n)) {
+                        if (type == kFrameValue)
+                            receiver.deliver(p, n, host_now_ns);
+                        else if (type == kFrameLink && rx.link_take)
+                            rx.link_take(p, n);
+                    }
+                    if (rx.link_poll)
+                        rx.link_poll();
+                }
+                host_delay_ns(kLoopNs);
+                now_rx = host_now_ns;
+            }
+        }
+        host::select(cpu_tx);
+        r.tx = tx.link();
+        if (rx.link) {
+            host::select(cpu_rx);
+            r.rx = rx.link();
+        }
+    } catch (const std::exception& e) {
+        r.why = e.what();
+    }
+    host::select(cpu_rx);
+    host::attach(nullptr);
+    host::select(cpu_tx);
+    host::attach(nullptr);
+    host::select(nullptr);
+
+    r.sent = static_cast<unsigned>(sent_at.size());
+    r.good = values.good;
+    r.bad = values.bad;
+    r.lost = values.lost + r.sent - std::min<uint32_t>(receiver.expected(), r.sent);
+    const unsigned rx_baud = rx.link ? r.rx.baud : rx.baud_actual;
+
+    if (r.why.empty() && !r.up_ns)
+        r.why = "link_poll() never returned TRUE";
+    if (r.why.empty() && (r.tx.baud != k.want || rx_baud != k.want))
+        r.why = "not at the expected rate";
+    if (r.why.empty() && r.tx.fallbacks != (rx.link ? 0u : 1u))
+        r.why = "initiator fallbacks";
+    if (r.why.empty() && rx.link && r.rx.fallbacks != (k.reset ? 1u : 0u))
+        r.why = "responder fallbacks";
+    if (r.why.empty() && rx.link && (r.tx.state != kLinkUp || r.rx.state != kLinkUp))
+        r.why = "not up";
+    if (r.why.empty() && k.lose_ok && pty.back().stats().lost != kLinkOkWire)
+        r.why = "LINK_OK not lost";
+    if (r.why.empty() && k.abd && (r.tx.peer_lock_ms == 0xFFFF || r.tx.peer_lock_ms != r.rx.lock_us / 1000))
+        r.why = "lock time not reported";
+    if (r.why.empty() && !k.abd && r.tx.peer_lock_ms != 0xFFFF)
+        r.why = "lock time without autobaud.c";
+    if (r.why.empty() && (r.good <= good_at_reset || r.bad))
+        r.why = "values not delivered after the link came up";
+    if (r.why.empty() && r.lost && !k.reset)
+        r.why = "values lost";
+    return r;
+}
+
+void print_link(const LinkCase& k, const LinkResult& r)
+{
+    char lock[16];
+    std::snprintf(lock, sizeof lock, r.tx.peer_lock_ms == 0xFFFF ? "-" : "%u", r.tx.peer_lock_ms);
+    std::printf("%-9s %8u %8u %3u %3u  %7.1f %7s  %6u %6u %5u %5u  %s\n", k.name, r.tx.baud,
+                k.rx->link ? r.rx.baud : k.rx->baud_actual, r.tx.fallbacks, r.rx.fallbacks,
+                r.up_ns / 1e6, lock, r.sent, r.good, r.lost, r.bad,
+                r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-5s %4s %15s %4s %6s  %6s %6s %5s %5s  %8s %5s  %9s %9s  %4s %4s %4s %4s  %6s %6s\n",
+                "proto", "size", "baud", "load", "err/B", "sent", "good", "lost", "bad", "B/s",
+                "line%", "lat avg", "lat max", "ferr", "oerr", "rej", "inj", "tx isr", "rx isr");
+
+    const std::vector<Link> links = {
+        {picusb::serial_node_tx_9600(), picusb::serial_node_rxraw_9600(),
+         picusb::serial_node_rxframe_9600()},
+        {picusb::serial_node_tx_115200(), picusb::serial_node_rxraw_115200(),
+         picusb::serial_node_rxframe_115200()},
+        {picusb::serial_node_tx_1000000(), picusb::serial_node_rxraw_1000000(),
+         picusb::serial_node_rxframe_1000000()},
+    };
+    const struct {
+        bool framed, isr;
+        unsigned size;
+    } protocols[] = {{false, false, 1}, {true, false, 1}, {true, false, 16}, {true, true, 1}};
+    const struct {
+        unsigned load;
+        double errors;
+    } conditions[] = {{0, 0}, {50, 0}, {0, 1e-2}};
+
+    host::Cpu* cpu_tx = host::new_cpu();
+    host::Cpu* cpu_rx = host::new_cpu();
+    bool ok = true;
+    for (const auto& p : protocols)
+        for (const Link& l : links)
+            for (const auto& k : conditions) {
+                const Case c{p.framed, p.isr, p.size, k.load, k.errors, false};
+                const SerialNode& rx = p.framed ? l.rxframe : l.rxraw;
+                const Result r = run(l.tx, rx, c, cpu_tx, cpu_rx);
+                print(l.tx, rx, c, r);
+                ok = ok && r.why.empty();
+            }
+    for (const auto& p : protocols) {
+        const Case c{p.framed, p.isr, p.size, 0, 0, true};
+        const SerialNode& rx = p.framed ? links[2].rxframe : links[2].rxraw;
+        const Result r = run(links[1].tx, rx, c, cpu_tx, cpu_rx);
+        print(links[1].tx, rx, c, r);
+        ok = ok && r.why.empty();
+    }
+    const SerialNode txflow = picusb::serial_node_txflow_1000000();
+    const struct {
+        SerialNode tx, rx;
+        bool framed, flow;
+    } slowed[] = {{links[2].tx, links[2].rxraw, false, false},
+                  {txflow, picusb::serial_node_rxflow_1000000(), false, true},
+                  {links[2].tx, links[2].rxframe, true, false},
+                  {txflow, picusb::serial_node_rxframeflow_1000000(), true, true}};
+    for (const auto& s : slowed) {
+        Case c{s.framed, false, 1, 0, 0, false};
+        c.slow = s.framed ? kSlowPasses * (c.size + 6) : kSlowPasses;
+        c.flow = s.flow;
+        const Result r = run(s.tx, s.rx, c, cpu_tx, cpu_rx);
+        print(s.tx, s.rx, c, r);
+        ok = ok && r.why.empty();
+    }
+
+    std::printf("\n%-9s %8s %8s %3s %3s  %7s %7s  %6s %6s %5s %5s\n", "link", "tx baud", "rx baud",
+                "fbt", "fbr", "up ms", "lock ms", "sent", "good", "lost", "bad");
+    const SerialNode linki = picusb::serial_node_linki_115200();
+    const SerialNode linkr = picusb::serial_node_linkr_115200();
+    const SerialNode linkr250k = picusb::serial_node_linkr250k_115200();
+    const SerialNode abdi = picusb::serial_node_abdi_115200();
+    const SerialNode abdr = picusb::serial_node_abdr_9600();
+    const LinkCase linked[] = {
+        {"up", &linki, &linkr, false, false, false, 1000000},
+        {"max", &linki, &linkr250k, false, false, false, 250000},
+        {"old", &linki, &links[1].rxframe, false, false, false, linki.baud_actual},
+        {"lostok", &linki, &linkr, false, true, false, 1000000},
+        {"reset", &linki, &linkr, false, false, true, 1000000},
+        {"abd", &abdi, &abdr, true, false, false, 1000000},
+        {"abdreset", &abdi, &abdr, true, false, true, 1000000},
+    };
+    for (const LinkCase& k : linked) {
+        const LinkResult r = run_link(k, cpu_tx, cpu_rx);
+        print_link(k, r);
+        ok = ok && r.why.empty();
+    }
+    return ok ? 0 : 1;
+}
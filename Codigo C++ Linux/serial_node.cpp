@@ -0,0 +1,287 @@
+// serial_node.cpp - the serial modules of Serial/Envio or Serial/Recibe
+// built for the host with the defines given on the command line
+// (-DSERIAL_NODE=name, -DUART_BAUD=rate and one of SERIAL_TX,
+// SERIAL_RXRAW, SERIAL_RXFRAME; SERIAL_BUS adds bus9.c to SERIAL_TX or
+// SERIAL_RXFRAME, with -DBUS_ADDR=addr on receivers; UART_TX_FLOW and
+// UART_RX_FLOW turn on the flow control of uart_tx.c and uart_rx.c;
+// SERIAL_LINK adds link.c to SERIAL_TX, with LINK_INITIATOR, or to
+// SERIAL_RXFRAME with uart_tx.c, and SERIAL_ABD autobaud.c to those).
+#include "serial_node.h"
+#include "ccs_host.h"
+
+#include <cstring>
+#include <utility>
+
+#ifndef SERIAL_NODE
+#error Define SERIAL_NODE, see the Makefile
+#endif
+
+#ifdef SERIAL_RXFRAME
+namespace {
+std::function<bool(uint8_t, const uint8_t*, uint8_t)> host_take;
+}
+#define frame_rx_take(p) (host_take && host_take((p)[0], (p) + 2, (p)[1]))
+#endif
+
+#ifdef SERIAL_LINK
+// sched.c: the modelled time of this PIC instead of Timer0 and Timer1
+#define sched_now()      static_cast<int16>(host_now_ns / 1000000)
+#define sched_cycles32() static_cast<int32>(host_now_ns / (4000000000ULL / HOST_CLOCK))
+#if defined(SERIAL_ABD) && !defined(LINK_INITIATOR)
+#define link_lost()      abd_start()      // as Recibe with use_autobaud
+#endif
+#endif
+
+#define getenv(s) HOST_CLOCK
+namespace SERIAL_NODE {
+#include "uart_baud_host.h"
+#if defined(SERIAL_TX)
+#include "frame_host.h"
+#ifdef SERIAL_BUS
+#include "bus9_host.h"
+#endif
+#include "uart_tx_host.h"
+#elif defined(SERIAL_RXFRAME)
+#include "frame_host.h"
+#ifdef SERIAL_BUS
+#include "bus9_host.h"
+#endif
+#ifdef SERIAL_LINK
+#include "uart_tx_host.h"
+#endif
+#include "uart_rx_host.h"
+#elif defined(SERIAL_RXRAW)
+#include "uart_rx_host.h"
+#else
+#error Define SERIAL_TX, SERIAL_RXRAW or SERIAL_RXFRAME
+#endif
+#ifdef SERIAL_ABD
+#include "autobaud_host.h"
+#endif
+#ifdef SERIAL_LINK
+#include "link_host.h"
+#endif
+const unsigned host_baud_actual = UART_BAUD_ACTUAL;
+}
+#undef getenv
+
+#define SERIAL_CAT2(a, b) a##b
+#define SERIAL_CAT(a, b)  SERIAL_CAT2(a, b)
+#define SERIAL_STR2(a)    #a
+#define SERIAL_STR(a)     SERIAL_STR2(a)
+
+namespace {
+
+namespace fw = SERIAL_NODE;
+
+void setup()
+{
+#if defined(SERIAL_TX) || defined(SERIAL_RXFRAME)
+    fw::frame_tx_busy = FALSE;
+    fw::frame_tx_frames = 0;
+    fw::frame_rx_w = fw::frame_rx_r = 0;
+    fw::frame_rx_avail = FALSE;
+    fw::frame_rx_restart();
+    fw::frame_rx_crc_errors = fw::frame_rx_bad = fw::frame_rx_dropped = fw::frame_rx_frames = 0;
+#endif
+#if defined(SERIAL_TX) || defined(SERIAL_LINK)
+    fw::uart_tx_head = fw::uart_tx_tail = 0;
+    fw::uart_tx_full = 0;
+    host::set_isr(INT_TBE, fw::uart_tx_isr);
+#endif
+    setup_adc_ports(NO_ANALOGS | VSS_VDD);      // both mains: RB0..RB4 digital
+#ifdef UART_TX_FLOW
+    fw::uart_tx_held = 0;
+    host::set_isr(INT_EXT2, fw::uart_tx_cts_isr);
+#endif
+#ifndef SERIAL_TX
+    fw::uart_rx_head = fw::uart_rx_tail = 0;
+    fw::uart_rx_overruns = fw::uart_rx_framing = fw::uart_rx_dropped = 0;
+    host::set_isr(INT_RDA, fw::uart_rx_isr);
+    enable_interrupts(INT_RDA);
+#endif
+#ifdef UART_RX_FLOW
+    fw::UART_RTS = 0;
+    set_tris_b(0xF7);                // RB3 out, as the application does
+#endif
+    fw::uart_baud_setup();
+#ifdef SERIAL_BUS
+    fw::bus_tx_addressed = FALSE;
+#ifdef BUS_ADDR
+    fw::bus_rx_9th = FALSE;
+    fw::bus_rx_others = 0;
+#endif
+    fw::bus_setup();
+#endif
+#ifdef SERIAL_ABD
+    fw::abd_state = ABD_MEASURE;
+    fw::abd_deadline = sched_now();
+#endif
+    enable_interrupts(GLOBAL);
+}
+
+#ifdef SERIAL_TX
+bool put(const uint8_t* p, uint8_t n)
+{
+    BYTE buf[256];
+    std::memcpy(buf, p, n);
+    return fw::uart_tx_write(buf, n);
+}
+
+bool send(uint8_t type, const uint8_t* p, uint8_t n)
+{
+    BYTE buf[256];
+    std::memcpy(buf, p, n);
+    return fw::frame_send(type, buf, n);
+}
+#endif
+
+#if defined(SERIAL_TX) && defined(SERIAL_BUS)
+bool bus_send(uint8_t addr, uint8_t type, const uint8_t* p, uint8_t n)
+{
+    BYTE buf[256];
+    std::memcpy(buf, p, n);
+    return fw::bus_send(addr, type, buf, n);
+}
+#endif
+
+#ifdef SERIAL_RXRAW
+int get()
+{
+    return fw::uart_rx_ready() ? fw::uart_rx_get() : -1;
+}
+#endif
+
+#ifdef SERIAL_RXFRAME
+bool receive(uint8_t* type, uint8_t* p, uint8_t* n)
+{
+    using namespace SERIAL_NODE;     // the frame_rx_* macros name the buffers
+    if (!fw::frame_rx_ready())
+        return false;
+    *type = fw::frame_rx_type();
+    *n = fw::frame_rx_len();
+    for (unsigned i = 0; i < *n; ++i)
+        p[i] = fw::frame_rx_data(i);
+    fw::frame_rx_done();
+    return true;
+}
+
+void set_take(std::function<bool(uint8_t, const uint8_t*, uint8_t)> take)
+{
+    host_take = std::move(take);
+}
+#endif
+
+#ifdef SERIAL_LINK
+#ifndef LINK_INITIATOR
+void link_take(const uint8_t* p, uint8_t n)
+{
+    BYTE buf[256];
+    std::memcpy(buf, p, n);
+    fw::link_take(buf, n);
+}
+#endif
+
+picusb::SerialLink link()
+{
+    picusb::SerialLink l;
+    l.state = fw::link_state;
+    l.baud = fw::link_baud;
+    l.fallbacks = fw::link_fallbacks;
+    l.peer_lock_ms = fw::link_peer_lock_ms;
+#if defined(SERIAL_ABD) && !defined(LINK_INITIATOR)
+    l.lock_us = fw::abd_lock_cycles * 4 / (HOST_CLOCK / 1000000);   // abd_lock_us()
+#endif
+    return l;
+}
+#endif
+
+#ifdef SERIAL_ABD
+bool abd_poll()
+{
+#ifdef LINK_INITIATOR
+    return fw::abd_sync_poll();
+#else
+    return fw::abd_poll();
+#endif
+}
+#endif
+
+picusb::SerialCounters counters()
+{
+    picusb::SerialCounters c;
+#ifdef SERIAL_TX
+    c.tx_full = fw::uart_tx_full;
+#ifdef UART_TX_FLOW
+    c.tx_held = fw::uart_tx_held;
+#endif
+#else
+    c.rx_overruns = fw::uart_rx_overruns;
+    c.rx_framing = fw::uart_rx_framing;
+    c.rx_dropped = fw::uart_rx_dropped;
+#endif
+#ifdef SERIAL_RXFRAME
+    c.crc_errors = fw::frame_rx_crc_errors;
+    c.bad_frames = fw::frame_rx_bad;
+    c.dropped_frames = fw::frame_rx_dropped;
+#endif
+#ifdef BUS_ADDR
+    c.bus_others = fw::bus_rx_others;
+#endif
+    return c;
+}
+
+picusb::SerialNode node()
+{
+    picusb::SerialNode n{};
+    n.name = SERIAL_STR(SERIAL_NODE);
+    n.baud = UART_BAUD;
+    n.baud_actual = fw::host_baud_actual;
+    n.setup = setup;
+#ifdef SERIAL_TX
+    n.put = put;
+    n.send = send;
+#endif
+#ifdef SERIAL_RXRAW
+    n.get = get;
+#endif
+#ifdef SERIAL_RXFRAME
+    n.receive = receive;
+    n.set_take = set_take;
+#endif
+#if defined(SERIAL_TX) && defined(SERIAL_BUS)
+    n.bus_send = bus_send;
+#endif
+#ifdef BUS_ADDR
+    n.bus_addr = BUS_ADDR;
+#endif
+    n.counters = counters;
+#ifdef SERIAL_LINK
+    n.link_init = fw::link_init;
+    n.link_poll = fw::link_poll;
+#ifndef LINK_INITIATOR
+    n.link_take = link_take;
+#endif
+    n.link = link;
+#endif
+#ifdef SERIAL_ABD
+#ifndef LINK_INITIATOR
+    n.abd_start = fw::abd_start;
+#endif
+    n.abd_poll = abd_poll;
+#endif
+    return n;
+}
+
+#ifdef BUS_ADDR
+const bool registered = (picusb::serial_bus_nodes().push_back(node()), true);
+#endif
+
+} // namespace
+
+#ifndef BUS_ADDR
+picusb::SerialNode picusb::SERIAL_CAT(serial_node_, SERIAL_NODE)()
+{
+    return node();
+}
+#endif
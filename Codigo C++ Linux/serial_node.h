@@ -0,0 +1,120 @@
+// serial_node.h - the serial modules of one PIC (Serial/Envio or
+// Serial/Recibe) running on the host.
+//
+// serial_node.cpp is compiled once per role and UART_BAUD (see
+// SERIAL_NODES in the Makefile), each time inside its own namespace, and
+// hands its entry points to serial_bench through this table:
+//
+//   tx_<baud>       frame.c + uart_tx.c, as Envio (raw bytes or frames)
+//   rxraw_<baud>    uart_rx.c alone, raw bytes as Recibe before frames
+//   rxframe_<baud>  frame.c + uart_rx.c, as Recibe
+//   txflow_<baud>   tx_<baud> with UART_TX_FLOW, as Envio with use_flow
+//   rxflow_<baud>   rxraw_<baud> with UART_RX_FLOW, RTS on RB3
+//   rxframeflow_<baud> rxframe_<baud> with UART_RX_FLOW, as Recibe with
+//                   use_flow
+//   bustx_<baud>    frame.c + bus9.c + uart_tx.c, as Envio with use_bus9
+//   linki_<baud>    tx_<baud> with link.c, the initiator, as Envio with
+//                   use_link
+//   linkr_<baud>    rxframe_<baud> with uart_tx.c and link.c, the
+//                   responder, as Recibe with use_link
+//   linkr250k_<baud> linkr_<baud> with LINK_MAX_BAUD 250000, an older
+//                   responder that does not offer the faster rates
+//   abdi_<baud>     linki_<baud> with autobaud.c (abd_sync_poll()), as
+//                   Envio with use_link and use_autobaud
+//   abdr_<baud>     linkr_<baud> with autobaud.c (abd_poll()), as Recibe
+//                   with use_link and use_autobaud; link_lost() starts
+//                   measuring again
+//   busrx_<addr>    frame.c + bus9.c + uart_rx.c at 1000000 baud, as the
+//                   Recibe with BUS_ADDR addr on the multidrop bus
+//
+// sched.c is not there: sched_now() and sched_cycles32() of the link
+// nodes read the modelled time of their PIC.
+//
+// The busrx nodes linked in (BUS_ADDRS in the Makefile) add themselves to
+// serial_bus_nodes(), in no particular order.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace picusb {
+
+struct SerialCounters {
+    unsigned tx_full = 0;           // uart_tx_full
+    unsigned tx_held = 0;           // uart_tx_held
+    unsigned rx_overruns = 0;       // uart_rx_overruns
+    unsigned rx_framing = 0;        // uart_rx_framing
+    unsigned rx_dropped = 0;        // uart_rx_dropped
+    unsigned crc_errors = 0;        // frame_rx_crc_errors
+    unsigned bad_frames = 0;        // frame_rx_bad
+    unsigned dropped_frames = 0;    // frame_rx_dropped
+    unsigned bus_others = 0;        // bus_rx_others
+};
+
+struct SerialLink {
+    unsigned state = 0;             // link_state, 6: LINK_UP
+    unsigned baud = 0;              // link_baud
+    unsigned fallbacks = 0;         // link_fallbacks
+    unsigned peer_lock_ms = 0;      // link_peer_lock_ms
+    unsigned lock_us = 0;           // abd_lock_us() of an abdr node
+};
+
+struct SerialNode {
+    const char* name;
+    unsigned baud;                  // UART_BAUD
+    unsigned baud_actual;           // UART_BAUD_ACTUAL
+    void (*setup)();                // module state as at reset, uart_baud_setup(), handlers
+    // tx_*: null elsewhere
+    bool (*put)(const uint8_t* p, uint8_t n);                    // uart_tx_write()
+    bool (*send)(uint8_t type, const uint8_t* p, uint8_t n);     // frame_send()
+    // bustx_*: bus_send()
+    bool (*bus_send)(uint8_t addr, uint8_t type, const uint8_t* p, uint8_t n);
+    // busrx_*: BUS_ADDR
+    unsigned bus_addr;
+    // rxraw_*: next byte from uart_rx_get(), -1 when none
+    int (*get)();
+    // rxframe_*: the waiting frame, then frame_rx_done()
+    bool (*receive)(uint8_t* type, uint8_t* p, uint8_t* n);
+    // rxframe_*: frame_rx_take(), each checked frame from inside #int_RDA
+    // as Recibe's SalidaTrama() gets it; true if used, so receive() never
+    // sees it.  Empty (the default after loading) leaves every frame to
+    // receive().
+    void (*set_take)(std::function<bool(uint8_t type, const uint8_t* p, uint8_t n)> take);
+    SerialCounters (*counters)();
+    // link*_ and abd*_: null elsewhere
+    void (*link_init)();            // link_init()
+    bool (*link_poll)();            // link_poll()
+    void (*link_take)(const uint8_t* p, uint8_t n);             // responders: link_take()
+    SerialLink (*link)();
+    // abd*_: abd_start() (responder), abd_sync_poll() or abd_poll()
+    void (*abd_start)();
+    bool (*abd_poll)();
+};
+
+SerialNode serial_node_tx_9600();
+SerialNode serial_node_tx_115200();
+SerialNode serial_node_tx_1000000();
+SerialNode serial_node_rxraw_9600();
+SerialNode serial_node_rxraw_115200();
+SerialNode serial_node_rxraw_1000000();
+SerialNode serial_node_rxframe_9600();
+SerialNode serial_node_rxframe_115200();
+SerialNode serial_node_rxframe_1000000();
+SerialNode serial_node_txflow_1000000();
+SerialNode serial_node_rxflow_1000000();
+SerialNode serial_node_rxframeflow_1000000();
+SerialNode serial_node_bustx_1000000();
+SerialNode serial_node_linki_115200();
+SerialNode serial_node_linkr_115200();
+SerialNode serial_node_linkr250k_115200();
+SerialNode serial_node_abdi_115200();
+SerialNode serial_node_abdr_9600();
+
+inline std::vector<SerialNode>& serial_bus_nodes()
+{
+    static std::vector<SerialNode> nodes;
+    return nodes;
+}
+
+} // namespace picusb
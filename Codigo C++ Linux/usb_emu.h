@@ -0,0 +1,319 @@
+// usb_emu.h - the PicUSB as the cable sees it, for picusb::open_socket():
+// endpoint 1 of pc_usb.c in command mode and in the bridge mode of
+// usb_uart.c, with a PIC B on the UART that sends back every byte.
+//
+// EmuDevice listens on a SOCK_SEQPACKET socket (picusb.h, namespace wire)
+// in a thread of its own and serves one connection at a time, as the board
+// has one host; closing it, as QWrite() does after every write, leaves the
+// firmware as it was.  Each OUT packet and IN token is answered latency
+// after it arrived at the earliest, the time the host controller takes to
+// get a transfer into a frame of the bus, and later if the firmware is not
+// ready for it: an OUT packet waits for room, a token for an IN packet.
+//
+// Command mode takes TIPO_COMANDO (88: the value goes to values()) and
+// TIPO_PUENTE (95: a 21 byte answer, then bridge mode); other commands are
+// ignored.  In bridge mode an OUT packet waits until the 64 bytes of the
+// uart_tx.c queue have room for it (naks()).  Its bytes leave at baud/10
+// a second and come back from PIC B as they arrive; they are sent in IN
+// packets when 32 have come or none for USB_UART_FLUSH_MS, with the 64
+// bytes of the uart_rx.c queue behind a packet the host has not collected.
+// What does not fit there is lost (lost()), as on the board.  With
+// Config::in_halted the IN endpoint is halted, as after a STALL.
+#pragma once
+
+#include "picusb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace picusb {
+
+class EmuDevice {
+public:
+    struct Config {
+        unsigned latency_us = 1000;          // one frame of the full speed bus
+        unsigned baud = 1000000;             // UART_BAUD of pc_usb.c
+        bool in_halted = false;              // EP1 IN answers every token with a stall
+    };
+
+    static constexpr uint8_t kComando = 88;  // TIPO_COMANDO
+    static constexpr uint8_t kPuente = 95;   // TIPO_PUENTE
+    static constexpr unsigned kTxSize = 64;  // UART_TX_SIZE
+    static constexpr unsigned kRxSize = 64;  // UART_RX_SIZE
+    static constexpr unsigned kFlushMs = 1;  // USB_UART_FLUSH_MS
+
+    // Listens at path, a leading '@' for the abstract namespace.
+    EmuDevice(const std::string& path, Config c) : c_(c)
+    {
+        sockaddr_un a{};
+        a.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof a.sun_path)
+            throw std::runtime_error("bad socket path '" + path + "'");
+        std::memcpy(a.sun_path, path.data(), path.size());
+        if (path[0] == '@')
+            a.sun_path[0] = '\0';
+        const socklen_t len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+        listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr*>(&a), len) < 0 ||
+            listen(listen_fd_, 4) < 0) {
+            const std::string why = std::strerror(errno);
+            if (listen_fd_ >= 0)
+                close(listen_fd_);
+            throw std::runtime_error("cannot listen at " + path + ": " + why);
+        }
+        stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        byte_ = std::chrono::nanoseconds(10000000000ULL / c_.baud);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~EmuDevice()
+    {
+        const uint64_t v = 1;
+        if (write(stop_fd_, &v, sizeof v) < 0) {
+            // the thread sees it anyway
+        }
+        thread_.join();
+        if (conn_ >= 0)
+            close(conn_);
+        close(listen_fd_);
+        close(stop_fd_);
+    }
+
+    EmuDevice(const EmuDevice&) = delete;
+    EmuDevice& operator=(const EmuDevice&) = delete;
+
+    // TIPO_COMANDO values, in the order they came.
+    std::vector<uint8_t> values() const
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return values_;
+    }
+    unsigned connections() const { return connections_; }
+    unsigned naks() const { return naks_; }          // OUT packets that waited for room
+    unsigned lost() const { return lost_; }          // bridge bytes with no room in uart_rx.c
+    bool bridge() const { return bridge_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        uint16_t seq;
+        Clock::time_point at;                // arrived
+        std::vector<uint8_t> data;           // OUT
+        bool held = false;                   // counted in naks_
+    };
+
+    void run()
+    {
+        for (;;) {
+            const Clock::time_point now = Clock::now();
+            step(now);
+            pollfd p[2] = {{stop_fd_, POLLIN, 0}, {conn_ >= 0 ? conn_ : listen_fd_, POLLIN, 0}};
+            const Clock::time_point next = next_event();
+            timespec ts{1, 0};
+            if (next != Clock::time_point::max()) {
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::max(next - Clock::now(), Clock::duration::zero())).count();
+                ts = {static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+            }
+            ppoll(p, 2, &ts, nullptr);
+            if (p[0].revents & POLLIN)
+                return;
+            if (conn_ < 0) {
+                if (p[1].revents & POLLIN) {
+                    conn_ = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (conn_ >= 0)
+                        ++connections_;
+                }
+                continue;
+            }
+            if (p[1].revents & (POLLIN | POLLHUP | POLLERR))
+                receive();
+        }
+    }
+
+    void receive()
+    {
+        uint8_t m[wire::kHeader + kPacketSize + 1];
+        for (;;) {
+            const ssize_t n = recv(conn_, m, sizeof m, MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                close(conn_);                // the host let go: what it had on the bus goes
+                conn_ = -1;
+                outs_.clear();
+                tokens_.clear();
+                return;
+            }
+            if (n < 0)
+                return;
+            if (n < static_cast<ssize_t>(wire::kHeader))
+                continue;
+            const uint16_t seq = m[2] | m[3] << 8;
+            const Clock::time_point now = Clock::now();
+            if (m[0] == wire::kCancel) {
+                for (std::deque<Pending>* q : {&outs_, &tokens_})
+                    q->erase(std::remove_if(q->begin(), q->end(),
+                                            [&](const Pending& p) { return p.seq == seq; }),
+                             q->end());
+            } else if (m[0] == wire::kOut && m[1] == kEpOut) {
+                outs_.push_back({seq, now, std::vector<uint8_t>(m + wire::kHeader, m + n)});
+            } else if (m[0] == wire::kIn && m[1] == kEpIn && !c_.in_halted) {
+                tokens_.push_back({seq, now, {}});
+            } else {
+                answer(wire::kStall, m[1], seq, nullptr, 0);
+            }
+        }
+    }
+
+    void answer(uint8_t op, uint8_t ep, uint16_t seq, const uint8_t* p, unsigned n)
+    {
+        uint8_t m[wire::kHeader + kPacketSize];
+        m[0] = op;
+        m[1] = ep;
+        m[2] = static_cast<uint8_t>(seq);
+        m[3] = static_cast<uint8_t>(seq >> 8);
+        if (n)
+            std::memcpy(m + wire::kHeader, p, n);
+        if (conn_ >= 0)
+            send(conn_, m, wire::kHeader + n, MSG_NOSIGNAL);
+    }
+
+    // Everything due up to now, in the order the firmware would do it.
+    void step(Clock::time_point now)
+    {
+        while (!tx_.empty() && next_byte_ <= now) {
+            rx(tx_.front(), next_byte_);
+            tx_.pop_front();
+            next_byte_ += byte_;
+        }
+        if (bridge_ && !armed_ && !in_buf_.empty() && now - last_rx_ >= std::chrono::milliseconds(kFlushMs))
+            arm();
+
+        const auto latency = std::chrono::microseconds(c_.latency_us);
+        while (!outs_.empty() && outs_.front().at + latency <= now) {
+            Pending& o = outs_.front();
+            if (bridge_) {
+                if (kTxSize - tx_.size() < o.data.size()) {
+                    if (!o.held)
+                        ++naks_;
+                    o.held = true;
+                    break;
+                }
+                if (tx_.empty())
+                    next_byte_ = now + byte_;
+                tx_.insert(tx_.end(), o.data.begin(), o.data.end());
+            } else {
+                command(o.data);
+            }
+            answer(wire::kAck, kEpOut, o.seq, nullptr, 0);
+            outs_.pop_front();
+        }
+        while (!tokens_.empty() && armed_ && tokens_.front().at + latency <= now) {
+            answer(wire::kData, kEpIn, tokens_.front().seq, packet_.data(),
+                   static_cast<unsigned>(packet_.size()));
+            tokens_.pop_front();
+            armed_ = false;
+            while (!rx_queue_.empty() && in_buf_.size() < kPacketSize) {
+                in_buf_.push_back(rx_queue_.front());
+                rx_queue_.pop_front();
+            }
+            if (in_buf_.size() == kPacketSize)
+                arm();
+        }
+    }
+
+    Clock::time_point next_event() const
+    {
+        const auto latency = std::chrono::microseconds(c_.latency_us);
+        Clock::time_point t = Clock::time_point::max();
+        if (!tx_.empty())
+            t = std::min(t, next_byte_);
+        if (bridge_ && !armed_ && !in_buf_.empty())
+            t = std::min(t, last_rx_ + std::chrono::milliseconds(kFlushMs));
+        if (!outs_.empty() && !outs_.front().held)
+            t = std::min(t, outs_.front().at + latency);
+        if (!tokens_.empty() && armed_)
+            t = std::min(t, tokens_.front().at + latency);
+        return t;
+    }
+
+    // TareaUSB, for the commands the emulation knows.
+    void command(const std::vector<uint8_t>& p)
+    {
+        if (p.size() < 2)
+            return;
+        if (p[0] == kComando) {
+            std::lock_guard<std::mutex> lock(m_);
+            values_.push_back(p[1]);
+        } else if (p[0] == kPuente) {
+            packet_.assign(21, 0);           // usb_uart_report(): nothing before
+            packet_[0] = kPuente;
+            armed_ = true;
+            bridge_ = true;
+        }
+    }
+
+    // A byte back from PIC B: usb_uart_isr_rx(), or the uart_rx.c queue.
+    void rx(uint8_t c, Clock::time_point t)
+    {
+        if (armed_ || !rx_queue_.empty()) {
+            if (rx_queue_.size() < kRxSize)
+                rx_queue_.push_back(c);
+            else
+                ++lost_;
+            return;
+        }
+        in_buf_.push_back(c);
+        last_rx_ = t;
+        if (in_buf_.size() == kPacketSize)
+            arm();
+    }
+
+    void arm()
+    {
+        packet_ = in_buf_;
+        in_buf_.clear();
+        armed_ = true;
+    }
+
+    const Config c_;
+    Clock::duration byte_;
+    int listen_fd_ = -1;
+    int stop_fd_ = -1;
+    int conn_ = -1;
+    std::thread thread_;
+
+    std::deque<Pending> outs_, tokens_;
+    std::atomic<bool> bridge_{false};
+    std::deque<uint8_t> tx_;                 // uart_tx.c
+    Clock::time_point next_byte_;            // the first of them is back from PIC B
+    std::vector<uint8_t> in_buf_;            // EP1 IN buffer, being filled
+    Clock::time_point last_rx_;
+    std::deque<uint8_t> rx_queue_;           // uart_rx.c
+    std::vector<uint8_t> packet_;            // armed for the next IN token
+    bool armed_ = false;
+
+    mutable std::mutex m_;
+    std::vector<uint8_t> values_;
+    std::atomic<unsigned> connections_{0};
+    std::atomic<unsigned> naks_{0};
+    std::atomic<unsigned> lost_{0};
+};
+
+} // namespace picusb
@@ -0,0 +1,345 @@
+// usb_host_bench - drives the emulated PicUSB of usb_emu.h through the
+// library of picusb.h over its socket transport, the way a program on the
+// PC would drive the board through libusb.  Reports transfers per second
+// with a new handle per write (as QWrite() of jpicusb.dll), with one
+// handle kept open and waiting on each write, and with 1 to 8 transfers in
+// flight; the exit status is 1 if any check fails.
+//
+//   usb_host_bench
+//
+// Rows:
+//   qwrite     open, TIPO_COMANDO, wait, close, kCommands times
+//   sync       one handle, each TIPO_COMANDO waited on with its future
+//   async      one handle, kCommands TIPO_COMANDO with callbacks, depth in
+//              flight, then flush()
+//   bridge     TIPO_PUENTE (its answer read through a future), then
+//              kBridgeBytes in 32 byte writes, depth in flight each way,
+//              every byte back from PIC B through start_reading()
+//   timeout    read() with nothing to send ends in Status::timeout and the
+//              handle goes on working
+//   unplug     the device goes away: a write ends in Status::no_device
+//   rstall     start_reading() with EP1 IN halted: on_packet gets the stall
+//              once, reading stops and starts again (twice)
+//   runplug    start_reading(), then the device goes away: on_packet gets
+//              Status::no_device once, and once more after start_reading()
+//
+// The device answers each packet one frame of the full speed bus (1ms)
+// after it arrived, and the UART of the bridge runs at 1000000 baud; the
+// times are wall clock, so only the checks are exact.  Checks: every
+// transfer ends ok, in the order it was made, the device gets every value
+// and byte once and in order, and the handle had depth transfers on the
+// bus at once.
+//
+// PIC B's bytes that find the uart_rx.c queue full are lost, as on the
+// board ("lost").  With one or two IN transfers waiting that happens when
+// the event thread is late by a few hundred microseconds, so there the
+// check is that the bytes back are the ones sent less the lost ones; from
+// kSafeDepth on nothing may be lost.
+#include "picusb.h"
+#include "usb_emu.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using picusb::Device;
+using picusb::EmuDevice;
+using picusb::Status;
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned kCommands = 200;
+constexpr unsigned kBridgeBytes = 32 * 200;
+constexpr unsigned kBridgeWaitMs = 2000;    // for the last bytes to come back
+constexpr unsigned kSafeDepth = 4;          // IN transfers that keep up with the UART
+
+enum class Mode { qwrite, sync, async, bridge, timeout, unplug, rstall, runplug };
+
+const char* mode_name(Mode m)
+{
+    switch (m) {
+    case Mode::qwrite: return "qwrite";
+    case Mode::sync: return "sync";
+    case Mode::async: return "async";
+    case Mode::bridge: return "bridge";
+    case Mode::timeout: return "timeout";
+    case Mode::unplug: return "unplug";
+    case Mode::rstall: return "rstall";
+    case Mode::runplug: return "runplug";
+    }
+    return "?";
+}
+
+struct Case {
+    Mode mode;
+    unsigned depth;
+};
+
+struct Result {
+    unsigned transfers = 0;
+    unsigned bytes = 0;         // bridge: back at the PC
+    double ms = 0;
+    Device::Stats stats;
+    unsigned naks = 0;
+    unsigned lost = 0;          // bridge: PIC B's bytes with no room in uart_rx.c
+    std::string why;
+};
+
+std::string socket_path()
+{
+    static unsigned n = 0;
+    return "@picusb-bench-" + std::to_string(getpid()) + "-" + std::to_string(n++);
+}
+
+std::vector<uint8_t> comando(unsigned i)
+{
+    return {EmuDevice::kComando, static_cast<uint8_t>(i)};
+}
+
+// The device got TIPO_COMANDO 0 to n - 1, in order.
+bool values_ok(const EmuDevice& emu, unsigned n)
+{
+    const std::vector<uint8_t> v = emu.values();
+    if (v.size() != n)
+        return false;
+    for (unsigned i = 0; i < n; ++i)
+        if (v[i] != static_cast<uint8_t>(i))
+            return false;
+    return true;
+}
+
+void commands(const Case& c, const std::string& path, EmuDevice& emu, Result& r)
+{
+    if (c.mode == Mode::qwrite) {
+        for (unsigned i = 0; i < kCommands; ++i) {
+            Device d(picusb::open_socket(path), 1);
+            if (d.write(comando(i)).get() != Status::ok)
+                r.why = "write failed";
+        }
+        r.transfers = kCommands;
+        if (r.why.empty() && emu.connections() != kCommands)
+            r.why = "not one connection per write";
+    } else if (c.mode == Mode::sync) {
+        Device d(picusb::open_socket(path), c.depth);
+        for (unsigned i = 0; i < kCommands; ++i)
+            if (d.write(comando(i)).get() != Status::ok)
+                r.why = "write failed";
+        r.stats = d.stats();
+        r.transfers = r.stats.writes;
+    } else {
+        Device d(picusb::open_socket(path), c.depth);
+        std::mutex m;
+        unsigned done = 0, bad = 0;
+        for (unsigned i = 0; i < kCommands; ++i)
+            d.write(comando(i), [&, i](Status s) {
+                std::lock_guard<std::mutex> lock(m);
+                bad += s != Status::ok || i != done;
+                ++done;
+            });
+        d.flush();
+        r.stats = d.stats();
+        r.transfers = r.stats.writes;
+        if (bad || done != kCommands)
+            r.why = "writes failed or out of order";
+        if (r.why.empty() && r.stats.max_out != c.depth)
+            r.why = "not depth writes in flight";
+    }
+    if (r.why.empty() && !values_ok(emu, kCommands))
+        r.why = "values lost or out of order";
+}
+
+void bridge(const Case& c, const std::string& path, EmuDevice& emu, Result& r)
+{
+    Device d(picusb::open_socket(path), c.depth);
+    std::future<Device::Packet> report = d.read(100);
+    const Status s = d.write({EmuDevice::kPuente, 0}).get();
+    const Device::Packet p = report.get();
+    if (s != Status::ok || p.status != Status::ok || p.data.size() != 21 ||
+        p.data[0] != EmuDevice::kPuente) {
+        r.why = "no answer to TIPO_PUENTE";
+        return;
+    }
+
+    std::mutex m;
+    std::vector<uint8_t> back;
+    unsigned read_errors = 0;
+    d.start_reading([&](Status s, const uint8_t* p, unsigned n) {
+        std::lock_guard<std::mutex> lock(m);
+        if (s != Status::ok)
+            ++read_errors;
+        else
+            back.insert(back.end(), p, p + n);
+    });
+    unsigned write_errors = 0;
+    for (unsigned at = 0; at < kBridgeBytes; at += picusb::kPacketSize) {
+        std::vector<uint8_t> out(picusb::kPacketSize);
+        for (unsigned k = 0; k < out.size(); ++k)
+            out[k] = static_cast<uint8_t>((at + k) * 7 + (at + k) / 256);
+        d.write(std::move(out), [&](Status s) {
+            std::lock_guard<std::mutex> lock(m);
+            write_errors += s != Status::ok;
+        });
+    }
+    d.flush();
+    const Clock::time_point give_up = Clock::now() + std::chrono::milliseconds(kBridgeWaitMs);
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (back.size() + emu.lost() >= kBridgeBytes || read_errors)
+                break;
+        }
+        if (Clock::now() >= give_up)
+            break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    d.stop_reading();
+
+    r.stats = d.stats();
+    r.transfers = r.stats.writes + r.stats.reads;
+    r.naks = emu.naks();
+    r.lost = emu.lost();
+    std::lock_guard<std::mutex> lock(m);
+    r.bytes = static_cast<unsigned>(back.size());
+    // back, in order, is what was sent less r.lost bytes
+    unsigned sent = 0;
+    for (uint8_t b : back) {
+        while (sent < kBridgeBytes && b != static_cast<uint8_t>(sent * 7 + sent / 256))
+            ++sent;
+        ++sent;
+    }
+    const bool same = sent <= kBridgeBytes && back.size() + r.lost == kBridgeBytes;
+    if (write_errors || read_errors)
+        r.why = "transfers failed";
+    else if (!same || (r.lost && c.depth >= kSafeDepth))
+        r.why = "bytes lost or wrong";
+    else if (r.stats.max_out != c.depth || r.stats.max_in != c.depth)
+        r.why = "not depth transfers in flight";
+}
+
+void timeout(const std::string& path, EmuDevice& emu, Result& r)
+{
+    Device d(picusb::open_socket(path), 1);
+    const Device::Packet p = d.read(20).get();
+    const Status s = d.write(comando(0)).get();
+    r.stats = d.stats();
+    r.transfers = 2;
+    if (p.status != Status::timeout)
+        r.why = std::string("read ended ") + picusb::status_name(p.status);
+    else if (s != Status::ok || !values_ok(emu, 1))
+        r.why = "no write after the timeout";
+}
+
+void unplug(const std::string& path, std::unique_ptr<EmuDevice>& emu, Result& r)
+{
+    Device d(picusb::open_socket(path), 1);
+    const Status before = d.write(comando(0)).get();
+    emu.reset();
+    const Status after = d.write(comando(1)).get();
+    r.stats = d.stats();
+    r.transfers = 2;
+    if (before != Status::ok)
+        r.why = "write failed";
+    else if (after != Status::no_device)
+        r.why = std::string("write after unplug ended ") + picusb::status_name(after);
+}
+
+// start_reading() twice, each ended by one error: the halted endpoint, or
+// the device gone before the first and still gone for the second.
+void read_error(const Case& c, const std::string& path, std::unique_ptr<EmuDevice>& emu, Result& r)
+{
+    const Status want = c.mode == Mode::rstall ? Status::stall : Status::no_device;
+    Device d(picusb::open_socket(path), c.depth);
+    std::mutex m;
+    std::condition_variable called;
+    std::vector<Status> calls;
+    const auto on_packet = [&](Status s, const uint8_t*, unsigned) {
+        std::lock_guard<std::mutex> lock(m);
+        calls.push_back(s);
+        called.notify_all();
+    };
+    for (unsigned round = 1; round <= 2 && r.why.empty(); ++round) {
+        d.start_reading(on_packet);          // throws if reading did not stop
+        if (c.mode == Mode::runplug && round == 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            emu.reset();
+        }
+        std::unique_lock<std::mutex> lock(m);
+        called.wait_for(lock, std::chrono::milliseconds(500), [&] { return calls.size() >= round; });
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));    // for calls that must not come
+        lock.lock();
+        if (calls.size() != round)
+            r.why = "on_packet called " + std::to_string(calls.size()) + " times for " +
+                    std::to_string(round) + " errors";
+        else if (calls.back() != want)
+            r.why = std::string("reading ended ") + picusb::status_name(calls.back());
+    }
+    r.stats = d.stats();
+    std::lock_guard<std::mutex> lock(m);
+    r.transfers = static_cast<unsigned>(calls.size());
+}
+
+Result run(const Case& c)
+{
+    Result r;
+    const std::string path = socket_path();
+    try {
+        EmuDevice::Config config;
+        config.in_halted = c.mode == Mode::rstall;
+        auto emu = std::make_unique<EmuDevice>(path, config);
+        const Clock::time_point t0 = Clock::now();
+        switch (c.mode) {
+        case Mode::qwrite:
+        case Mode::sync:
+        case Mode::async: commands(c, path, *emu, r); break;
+        case Mode::bridge: bridge(c, path, *emu, r); break;
+        case Mode::timeout: timeout(path, *emu, r); break;
+        case Mode::unplug: unplug(path, emu, r); break;
+        case Mode::rstall:
+        case Mode::runplug: read_error(c, path, emu, r); break;
+        }
+        r.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    } catch (const std::exception& e) {
+        r.why = e.what();
+    }
+    return r;
+}
+
+void print(const Case& c, const Result& r)
+{
+    const double s = r.ms / 1000;
+    std::printf("%-8s %5u  %6u %8.1f %8.0f %8.0f  %4u %4u %5u %6u %5u  %s\n", mode_name(c.mode),
+                c.depth, r.transfers, r.ms, s > 0 ? r.transfers / s : 0.0,
+                s > 0 ? r.bytes / s : 0.0, r.stats.max_out, r.stats.max_in, r.stats.failed,
+                r.naks, r.lost, r.why.empty() ? "ok" : ("FAIL: " + r.why).c_str());
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("%-8s %5s  %6s %8s %8s %8s  %4s %4s %5s %6s %5s\n", "mode", "depth", "xfers", "ms",
+                "xfers/s", "back B/s", "out", "in", "fail", "naks", "lost");
+
+    const Case cases[] = {
+        {Mode::qwrite, 1}, {Mode::sync, 1},    {Mode::async, 1},   {Mode::async, 2},
+        {Mode::async, 4},  {Mode::async, 8},   {Mode::bridge, 1},  {Mode::bridge, 2},
+        {Mode::bridge, 4}, {Mode::bridge, 8},  {Mode::timeout, 1}, {Mode::unplug, 1},
+        {Mode::rstall, 4}, {Mode::runplug, 4},
+    };
+    bool ok = true;
+    for (const Case& c : cases) {
+        const Result r = run(c);
+        print(c, r);
+        ok = ok && r.why.empty();
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// usb_sie.h - model of endpoint 1 of the PIC18F4550 USB SIE and of the
+// full speed host controller on the other side of the cable.
+//
+// The firmware side is what pic18_usb.c does with the buffer descriptors:
+// an OUT buffer armed by usb_flush_out() is filled by the next OUT packet
+// and handed back to the CPU; an IN buffer armed by usb_flush_in() is sent
+// on the next IN token.  Each finished transaction goes into the USTAT
+// FIFO and raises INT_USB until the interrupt handler takes it.
+//
+// The host controller sends OUT packets of up to kPacket bytes while the
+// PC application (a UsbHost) has data and the OUT buffer is armed, and
+// collects the IN buffer as soon as it is armed.  One transaction at a
+// time is on the bus, for as long as its packets take at 12 Mbit/s
+// (token, data and handshake with their sync fields, CRC and gaps, plus
+// bit stuffing); OUT and IN take turns when both are ready.  A pipe the
+// SIE NAKs is retried as soon as the buffer is armed again, as a host
+// controller with bus time to spare does; a busier bus or one that backs
+// off to the next frame adds up to 1ms.
+#pragma once
+
+#include "ccs_host.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+namespace picusb {
+
+// The PC application behind the host controller.
+struct UsbHost {
+    virtual ~UsbHost() = default;
+    // Bytes for the OUT packet starting at now, at most max; 0 for none.
+    virtual unsigned out_data(uint64_t now, uint8_t* p, unsigned max) = 0;
+    // Time out_data() will have bytes again, UINT64_MAX for never.
+    virtual uint64_t out_next() = 0;
+    // An IN packet arrived at now; the firmware armed it at armed.
+    virtual void in_data(uint64_t now, const uint8_t* p, unsigned n, uint64_t armed) = 0;
+};
+
+class UsbSie {
+public:
+    static constexpr unsigned kPacket = 32;      // USB_EP1_TX_SIZE, USB_EP1_RX_SIZE
+
+    // Bus time of a transaction carrying n data bytes.
+    static uint64_t transaction_ns(unsigned n)
+    {
+        const double bits = (3 + 3 + n + 2 + 1 + 3) * 8 * 7.0 / 6 + 3 * 8;   // packets, gaps
+        return static_cast<uint64_t>(bits * 1e9 / 12e6);
+    }
+
+    struct Stats {
+        unsigned out_packets = 0;
+        unsigned in_packets = 0;
+        unsigned max_fifo = 0;
+    };
+
+    explicit UsbSie(UsbHost* host) : host_(host) {}
+
+    // Firmware side -------------------------------------------------------
+
+    uint8_t out_buf[kPacket] = {};
+    uint8_t in_buf[kPacket] = {};
+
+    bool out_ready() const { return !out_armed_; }
+    unsigned out_len() const { return out_len_; }
+    void arm_out(uint64_t now)
+    {
+        out_armed_ = true;
+        out_at_ = now;
+    }
+
+    bool in_free() const { return !in_armed_; }
+    bool arm_in(unsigned n, uint64_t now)
+    {
+        if (in_armed_)
+            return false;
+        in_armed_ = true;
+        in_len_ = n;
+        in_at_ = now;
+        return true;
+    }
+
+    // USTAT: true for OUT; false when the FIFO is empty.
+    bool pop(unsigned* en, bool* out)
+    {
+        if (fifo_.empty())
+            return false;
+        *en = 1;
+        *out = fifo_.front();
+        fifo_.pop_front();
+        return true;
+    }
+    bool pending() const { return !fifo_.empty(); }
+
+    // Host controller -----------------------------------------------------
+
+    uint64_t next_event_ns() const
+    {
+        if (busy_)
+            return busy_end_;
+        uint64_t t = UINT64_MAX;
+        if (out_armed_)
+            t = std::max({bus_free_, out_at_, host_->out_next()});
+        if (in_armed_)
+            t = std::min(t, std::max(bus_free_, in_at_));
+        return t;
+    }
+
+    void advance_to(uint64_t now)
+    {
+        for (uint64_t ev = next_event_ns(); ev <= now; ev = next_event_ns()) {
+            if (busy_) {
+                finish();
+                continue;
+            }
+            start(ev);
+        }
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    void start(uint64_t t)
+    {
+        const bool can_out = out_armed_ && out_at_ <= t && host_->out_next() <= t;
+        const bool can_in = in_armed_ && in_at_ <= t;
+        bool out = can_out && (!can_in || !last_out_);
+        if (out) {
+            const unsigned n = host_->out_data(t, pending_, kPacket);
+            if (n == 0 && !can_in) {
+                bus_free_ = t + 1;               // asked too early, look again
+                return;
+            }
+            out = n != 0;
+            pending_len_ = n;
+        }
+        busy_ = true;
+        busy_out_ = out;
+        last_out_ = out;
+        busy_end_ = t + transaction_ns(out ? pending_len_ : in_len_);
+    }
+
+    void finish()
+    {
+        busy_ = false;
+        bus_free_ = busy_end_;
+        if (busy_out_) {
+            std::memcpy(out_buf, pending_, pending_len_);
+            out_len_ = pending_len_;
+            out_armed_ = false;
+            ++stats_.out_packets;
+        } else {
+            in_armed_ = false;
+            host_->in_data(busy_end_, in_buf, in_len_, in_at_);
+            ++stats_.in_packets;
+        }
+        fifo_.push_back(busy_out_);
+        stats_.max_fifo = std::max<unsigned>(stats_.max_fifo, fifo_.size());
+    }
+
+    UsbHost* host_;
+    bool out_armed_ = true;      // usb_set_configured() arms the OUT buffer
+    unsigned out_len_ = 0;
+    uint64_t out_at_ = 0;
+    bool in_armed_ = false;
+    unsigned in_len_ = 0;
+    uint64_t in_at_ = 0;
+
+    uint8_t pending_[kPacket] = {};
+    unsigned pending_len_ = 0;
+    bool busy_ = false;
+    bool busy_out_ = false;
+    bool last_out_ = false;
+    uint64_t busy_end_ = 0;
+    uint64_t bus_free_ = 0;
+
+    std::deque<bool> fifo_;
+    Stats stats_;
+};
+
+} // namespace picusb
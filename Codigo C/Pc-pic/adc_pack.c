@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////////
+////                             ADC_PACK.C                             ////
+////          Compact stream format for 10-bit ADC samples              ////
+////                                                                    ////
+////  adc_pack_begin(enc,s)  Starts a new packet in adc_pack_buf with   ////
+////                         s as the absolute first sample.            ////
+////                                                                    ////
+////  adc_pack_put(s)        Appends sample s.  Returns FALSE if s      ////
+////                         does not fit (packet full, or delta out    ////
+////                         of range for the encoding); send the       ////
+////                         packet and start a new one with s.         ////
+////                                                                    ////
+////  adc_pack_len()         Number of bytes of adc_pack_buf to send.   ////
+////                                                                    ////
+////  Packet layout (all multi-byte fields little endian):              ////
+////     [0]   ADC_PACK_MAGIC | encoding                                ////
+////     [1]   sample count, including the first sample                 ////
+////     [2,3] first sample                                             ////
+////     [4..] remaining samples, encoded as:                           ////
+////       ADC_PACK_RAW10   groups of 4 samples in 5 bytes: one byte    ////
+////                        with the 2 high bits of each sample (s0     ////
+////                        in bits 0-1), then the 4 low bytes.  A      ////
+////                        short last group is 1 + k bytes.            ////
+////       ADC_PACK_DELTA8  one zig-zag delta per byte (-128 to 127)    ////
+////       ADC_PACK_DELTA4  one zig-zag delta per nibble (-8 to 7),     ////
+////                        low nibble first                            ////
+////                                                                    ////
+////  A 32 byte packet carries 23 samples in RAW10, 29 in DELTA8 and    ////
+////  57 in DELTA4, against 16 as plain int16.                          ////
+////                                                                    ////
+////  The host decoder is in "Codigo C++ Linux/adc_pack.h".             ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADC_PACK_SIZE
+#define ADC_PACK_SIZE USB_EP1_TX_SIZE
+#endif
+
+#define ADC_PACK_MAGIC  0xA0
+#define ADC_PACK_RAW10  0
+#define ADC_PACK_DELTA8 1
+#define ADC_PACK_DELTA4 2
+
+#define ADC_PACK_HEADER 4
+
+int8 adc_pack_buf[ADC_PACK_SIZE];
+
+int8  adc_pack_enc;
+int8  adc_pack_pos;          // next free byte in adc_pack_buf
+int8  adc_pack_group;        // RAW10: index of the high-bits byte of the open group
+int8  adc_pack_k;            // RAW10: samples in the open group / DELTA4: nibble phase
+int16 adc_pack_prev;
+
+
+void adc_pack_begin(int8 enc, int16 first) {
+   adc_pack_enc = enc;
+   adc_pack_buf[0] = ADC_PACK_MAGIC | enc;
+   adc_pack_buf[1] = 1;
+   adc_pack_buf[2] = make8(first,0);
+   adc_pack_buf[3] = make8(first,1);
+   adc_pack_pos = ADC_PACK_HEADER;
+   adc_pack_k = 0;
+   adc_pack_prev = first;
+}
+
+
+int1 adc_pack_put(int16 sample) {
+   signed int16 d;
+   int8 z;
+
+   if (adc_pack_enc == ADC_PACK_RAW10) {
+      if (adc_pack_k == 0) {
+         if (adc_pack_pos + 2 > ADC_PACK_SIZE)
+            return(FALSE);
+         adc_pack_group = adc_pack_pos++;
+         adc_pack_buf[adc_pack_group] = 0;
+      }
+      else if (adc_pack_pos >= ADC_PACK_SIZE)
+         return(FALSE);
+      adc_pack_buf[adc_pack_group] |= (make8(sample,1) & 3) << (adc_pack_k << 1);
+      adc_pack_buf[adc_pack_pos++] = make8(sample,0);
+      adc_pack_k = (adc_pack_k + 1) & 3;
+   }
+   else {
+      // zig-zag: 0,-1,1,-2,2... -> 0,1,2,3,4...
+      d = (signed int16)sample - (signed int16)adc_pack_prev;
+      if (d < 0) {
+         if (d < -128) return(FALSE);
+         z = ((int8)(-d) << 1) - 1;
+      }
+      else {
+         if (d > 127) return(FALSE);
+         z = (int8)d << 1;
+      }
+
+      if (adc_pack_enc == ADC_PACK_DELTA8) {
+         if (adc_pack_pos >= ADC_PACK_SIZE)
+            return(FALSE);
+         adc_pack_buf[adc_pack_pos++] = z;
+      }
+      else {
+         if (z > 15)
+            return(FALSE);
+         if (adc_pack_k == 0) {
+            if (adc_pack_pos >= ADC_PACK_SIZE)
+               return(FALSE);
+            adc_pack_buf[adc_pack_pos++] = z;
+         }
+         else
+            adc_pack_buf[adc_pack_pos - 1] |= z << 4;
+         adc_pack_k ^= 1;
+      }
+      adc_pack_prev = sample;
+   }
+
+   adc_pack_buf[1]++;
+   return(TRUE);
+}
+
+
+int8 adc_pack_len() {
+   return(adc_pack_pos);
+}
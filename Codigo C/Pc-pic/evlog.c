@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////
+////                              EVLOG.C                               ////
+////           RAM circular event log with bulk readback                ////
+////                                                                    ////
+////  evlog(id,a,b)    Appends a record.  Inline, safe from the main    ////
+////                   loop and from interrupts.  When the log is full  ////
+////                   the oldest record is overwritten.                ////
+////                                                                    ////
+////  evlog_drain(ep)  Starts sending every record (oldest first) on    ////
+////                   endpoint ep; the log is emptied as they go.      ////
+////                                                                    ////
+////  evlog_drain_task() Call once per pass of the main loop.  Sends at ////
+////                   most one packet of a drain, none while the last  ////
+////                   one is still in the endpoint buffer, and never   ////
+////                   waits.  Returns TRUE while a drain is going on,  ////
+////                   so the caller leaves the endpoint to it.         ////
+////                                                                    ////
+////  Record (5 bytes): time lo, time hi, event id, arg a, arg b        ////
+////                                                                    ////
+////  EVLOG_TIME() is the timestamp source; by default Timer0.          ////
+////  pc_usb.c defines it as the 1ms scheduler tick (sched.c).          ////
+////                                                                    ////
+////  Drain packet: [0] EVLOG_MAGIC  [1] records in this packet         ////
+////                [2,3] EVLOG_TIME() when sent  [4..] records         ////
+////  The last packet of a drain always holds fewer than                ////
+////  EVLOG_PER_PACKET records (possibly none).                         ////
+////                                                                    ////
+////  Include this file after the descriptors and before usb.c and      ////
+////  LCD416.c so their hooks (usb_evlog, lcd_evlog) record into the    ////
+////  log.  The LCD logs its commands only, not every data byte, so a   ////
+////  flush of the screen takes a record or two.  The decoder is        ////
+////  "Codigo C++ Linux/evlog_decode.cpp".                              ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef EVLOG_SIZE
+#define EVLOG_SIZE 32                     // records kept
+#endif
+
+#ifndef EVLOG_TIME
+#define EVLOG_TIME() get_timer0()
+#endif
+
+#define EVLOG_REC   5
+#define EVLOG_BYTES (EVLOG_SIZE * EVLOG_REC)
+#define EVLOG_MAGIC 0xE1
+
+#if EVLOG_BYTES > 255
+#error EVLOG_SIZE too large, the log is indexed with int8
+#endif
+
+// Event ids.  Keep in sync with evlog_decode.cpp.
+#define EV_BOOT        1
+#define EV_USB_RESET   2
+#define EV_USB_STALL   3
+#define EV_USB_ERROR   4                  // a = UEIR
+#define EV_USB_SUSPEND 5
+#define EV_USB_RESUME  6
+#define EV_USB_CONFIG  7                  // a = configuration
+#define EV_CMD         8                  // a = command, b = parameter
+#define EV_LCD         9                  // a = data bytes since the last command, b = command
+#define EV_LOST        10                 // a = records overwritten before the drain
+#define EV_USB_WAKE    11                 // a,b = resume to first command, lo/hi
+
+#define usb_evlog(id,a,b) evlog(id,a,b)
+#define lcd_evlog(k,n)    evlog(EV_LCD,k,n)
+
+#bit EVLOG_GIEH = 0xFF2.7
+
+int8 evlog_buf[EVLOG_BYTES];
+int8 evlog_head;                          // byte offset of the next record
+int8 evlog_count;                         // records held
+int8 evlog_lost;                          // records overwritten since the last drain
+
+#inline
+void evlog(int8 id, int8 a, int8 b) {
+   int1 gie;
+   int8 *p;
+   int16 t;
+
+   t = EVLOG_TIME();
+   gie = EVLOG_GIEH;
+   EVLOG_GIEH = 0;
+   p = &evlog_buf[evlog_head];
+   evlog_head += EVLOG_REC;
+   if (evlog_head >= EVLOG_BYTES)
+      evlog_head = 0;
+   if (evlog_count < EVLOG_SIZE)
+      evlog_count++;
+   else if (evlog_lost != 0xFF)
+      evlog_lost++;
+   EVLOG_GIEH = gie;
+   *p++ = make8(t,0);
+   *p++ = make8(t,1);
+   *p++ = id;
+   *p++ = a;
+   *p = b;
+}
+
+#ifdef USB_EP1_TX_SIZE
+#define EVLOG_PER_PACKET ((USB_EP1_TX_SIZE - 4) / EVLOG_REC)
+
+int1 evlog_draining;                      // evlog_drain_task() has packets to send
+int8 evlog_ep;
+
+void evlog_drain(int8 ep) {
+   if (evlog_lost) {
+      evlog(EV_LOST, evlog_lost, 0);
+      evlog_lost = 0;
+   }
+   evlog_ep = ep;
+   evlog_draining = TRUE;
+}
+
+int1 evlog_drain_task(void) {
+   int8 pkt[4 + EVLOG_PER_PACKET * EVLOG_REC];
+   int8 n, i, tail;
+   int16 t;
+
+   if (!evlog_draining)
+      return(FALSE);
+   if (!usb_enumerated()) {
+      evlog_draining = FALSE;             // the host went away, nobody reads the rest
+      return(FALSE);
+   }
+   if (!usb_tbe(evlog_ep))
+      return(TRUE);                       // the last packet is not collected yet
+
+   n = 0;
+   disable_interrupts(GLOBAL);
+   while (evlog_count && n < EVLOG_PER_PACKET) {
+      // oldest record sits evlog_count records behind the head
+      i = evlog_count * EVLOG_REC;
+      if (evlog_head >= i)
+         tail = evlog_head - i;
+      else
+         tail = evlog_head + EVLOG_BYTES - i;
+      memcpy(&pkt[4 + n * EVLOG_REC], &evlog_buf[tail], EVLOG_REC);
+      evlog_count--;
+      n++;
+   }
+   enable_interrupts(GLOBAL);
+
+   t = EVLOG_TIME();
+   pkt[0] = EVLOG_MAGIC;
+   pkt[1] = n;
+   pkt[2] = make8(t,0);
+   pkt[3] = make8(t,1);
+   usb_put_packet(evlog_ep, pkt, 4 + n * EVLOG_REC, USB_DTS_TOGGLE);
+   if (n < EVLOG_PER_PACKET)
+      evlog_draining = FALSE;             // a short packet ends the drain
+   return(evlog_draining);
+}
+#endif
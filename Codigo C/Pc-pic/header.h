@@ -22,7 +22,7 @@ USB_TOTAL_CONFIG_LEN,0, //size of all data returned for this config
 1, //number of interfaces this device supports
 0x01, //identifier for this configuration. (IF we had more than one configurations)
 0x00, //index of string descriptor for this configuration
-0xC0, //bit 6=1 if self powered, bit 5=1 if supports remote wakeup (we don't), bits 0-4 reserved and bit7=1
+0xE0, //bit 6=1 if self powered, bit 5=1 if supports remote wakeup (we do, see usb_pm.c), bits 0-4 reserved and bit7=1
 0x32, //maximum bus power required (maximum milliamperes/2) (0x32 = 100mA)
 
 //interface descriptor 0 alt 0
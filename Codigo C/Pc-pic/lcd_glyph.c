@@ -0,0 +1,166 @@
+////////////////////////////////////////////////////////////////////////////
+////                            LCD_GLYPH.C                             ////
+////        Custom characters for LCD416.C through a CGRAM cache        ////
+////                                                                    ////
+////  lcd_glyph(id)   Returns the character code (0 to 7) that shows    ////
+////                  glyph id.  The 8 CGRAM slots hold the most        ////
+////                  recently used glyphs; a glyph is uploaded (one    ////
+////                  address command and 8 data writes) only when it   ////
+////                  is not loaded already.  Write the code with       ////
+////                  lcd_fb_store() or lcd_send_byte(1,c), not with    ////
+////                  the putc functions (8 to 15 mirror the slots but  ////
+////                  \b, \n and \f are in that range).                 ////
+////                                                                    ////
+////  lcd_bar(x,y,w,v,max) Horizontal bar of w cells at x,y, filled in  ////
+////                  v/max of its 5*w pixel columns.  Uses at most     ////
+////                  one slot (the partial end cell).                  ////
+////                                                                    ////
+////  lcd_meter(x,y,l) One cell vertical meter, level l from 0 to 8.    ////
+////                                                                    ////
+////  With use_lcd_fb the widgets write to the framebuffer, and a slot  ////
+////  whose glyph is still on the screen is only reused when every      ////
+////  slot is on the screen.  Without it they write to the LCD and a    ////
+////  miss moves the LCD address: call lcd_gotoxy() after lcd_glyph().  ////
+////                                                                    ////
+////  lcd_glyph_hits, lcd_glyph_misses count lookups and uploads.       ////
+////                                                                    ////
+////  Include after LCD416.c.                                           ////
+////////////////////////////////////////////////////////////////////////////
+
+#define LCD_GLYPH_SLOTS  8
+#define LCD_GLYPH_NONE   0xFF
+
+// Glyph ids, rows in LCD_GLYPHS
+#define LCD_GLYPH_BAR1   0           // bar end, 1 to 4 pixel columns lit
+#define LCD_GLYPH_BAR4   3
+#define LCD_GLYPH_METER1 4           // meter, 1 to 7 rows lit
+#define LCD_GLYPH_METER7 10
+#define LCD_GLYPH_USB    11
+#define LCD_GLYPH_WAIT   12
+#define LCD_GLYPH_COUNT  13
+
+#define LCD_CHAR_FULL    0xFF        // all pixels lit, in the character ROM
+
+BYTE const LCD_GLYPHS[LCD_GLYPH_COUNT][8] = {
+   {0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10},
+   {0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x18},
+   {0x1C,0x1C,0x1C,0x1C,0x1C,0x1C,0x1C,0x1C},
+   {0x1E,0x1E,0x1E,0x1E,0x1E,0x1E,0x1E,0x1E},
+   {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1F},
+   {0x00,0x00,0x00,0x00,0x00,0x00,0x1F,0x1F},
+   {0x00,0x00,0x00,0x00,0x00,0x1F,0x1F,0x1F},
+   {0x00,0x00,0x00,0x00,0x1F,0x1F,0x1F,0x1F},
+   {0x00,0x00,0x00,0x1F,0x1F,0x1F,0x1F,0x1F},
+   {0x00,0x00,0x1F,0x1F,0x1F,0x1F,0x1F,0x1F},
+   {0x00,0x1F,0x1F,0x1F,0x1F,0x1F,0x1F,0x1F},
+   {0x04,0x0E,0x04,0x15,0x15,0x0E,0x04,0x0E},
+   {0x1F,0x11,0x0A,0x04,0x0A,0x11,0x1F,0x00}};
+
+BYTE lcd_glyph_id[LCD_GLYPH_SLOTS] =   // glyph in each slot
+   {LCD_GLYPH_NONE, LCD_GLYPH_NONE, LCD_GLYPH_NONE, LCD_GLYPH_NONE,
+    LCD_GLYPH_NONE, LCD_GLYPH_NONE, LCD_GLYPH_NONE, LCD_GLYPH_NONE};
+BYTE lcd_glyph_used[LCD_GLYPH_SLOTS];  // lcd_glyph_clock at the last lookup
+BYTE lcd_glyph_clock;
+int16 lcd_glyph_hits;
+int16 lcd_glyph_misses;
+
+// Forget the slots, when lcd_init() is called again.
+void lcd_glyph_reset() {
+   memset(lcd_glyph_id, LCD_GLYPH_NONE, sizeof(lcd_glyph_id));
+}
+
+#ifdef use_lcd_fb
+int1 lcd_glyph_shown( BYTE slot) {
+   BYTE i;
+
+   for (i=0; i<sizeof(lcd_fb); ++i)
+      if (lcd_fb[i] == slot)
+         return(TRUE);
+   return(FALSE);
+}
+#endif
+
+BYTE lcd_glyph( BYTE id) {
+   BYTE slot, i, age, oldest;
+
+   ++lcd_glyph_clock;
+   for (slot=0; slot<LCD_GLYPH_SLOTS; ++slot)
+      if (lcd_glyph_id[slot] == id) {
+         lcd_glyph_used[slot] = lcd_glyph_clock;
+         ++lcd_glyph_hits;
+         return(slot);
+      }
+
+   // least recently used slot, free ones first (the clock wraps, ages
+   // are exact for the last 255 lookups)
+   oldest = 0;
+   slot = 0;
+   for (i=0; i<LCD_GLYPH_SLOTS; ++i) {
+      if (lcd_glyph_id[i] == LCD_GLYPH_NONE) {
+         slot = i;
+         break;
+      }
+      age = lcd_glyph_clock - lcd_glyph_used[i];
+#ifdef use_lcd_fb
+      if (!lcd_glyph_shown(i))
+         age |= 0x80;                // above anything still on screen
+      else
+         age >>= 1;
+#endif
+      if (age >= oldest) {
+         oldest = age;
+         slot = i;
+      }
+   }
+
+   lcd_send_byte(0, 0x40 | (slot << 3));
+   for (i=0; i<8; ++i)
+      lcd_send_byte(1, LCD_GLYPHS[id][i]);
+   lcd_glyph_id[slot] = id;
+   lcd_glyph_used[slot] = lcd_glyph_clock;
+   ++lcd_glyph_misses;
+   return(slot);
+}
+
+void lcd_glyph_put( BYTE x, BYTE y, char c) {
+#ifdef use_lcd_fb
+   lcd_fb_store((y-1) * LCD_COLS + x-1, c);
+#else
+   lcd_gotoxy(x,y);
+   lcd_send_byte(1,c);
+#endif
+}
+
+void lcd_bar( BYTE x, BYTE y, BYTE w, int16 v, int16 max) {
+   BYTE i, full, part;
+   int16 lit;
+   char c;
+
+   if (v >= max)
+      lit = w * 5;
+   else
+      lit = ((int32)v * (w * 5)) / max;
+   full = lit / 5;
+   part = lit % 5;
+   for (i=0; i<w; ++i, ++x) {
+      if (i < full)
+         c = LCD_CHAR_FULL;
+      else if (i == full && part)
+         c = lcd_glyph(LCD_GLYPH_BAR1 + part - 1);
+      else
+         c = ' ';
+      lcd_glyph_put(x, y, c);
+   }
+}
+
+void lcd_meter( BYTE x, BYTE y, BYTE l) {
+   char c;
+
+   if (l == 0)
+      c = ' ';
+   else if (l >= 8)
+      c = LCD_CHAR_FULL;
+   else
+      c = lcd_glyph(LCD_GLYPH_METER1 + l - 1);
+   lcd_glyph_put(x, y, c);
+}
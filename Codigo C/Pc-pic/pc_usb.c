@@ -1,5 +1,6 @@
 
 #include <18F4550.h>
+#device ADC=10
 #fuses HSPLL,NOWDT,NOPROTECT,NOLVP,NODEBUG,USBDIV,PLL5,CPUDIV1,VREGEN
 #use delay(clock=48000000)
 
@@ -15,33 +16,255 @@
 #define USB_EP1_RX_SIZE 32 // size to allocate for the rx endpoint 1 buffer
 
 
+#include "usb_uart.h" // puente USB-UART: ganchos antes de sched.c, uart_tx.c, uart_rx.c y usb.c
+#define TAREA_USB 0 // tareas del planificador (sched.c)
+#define TAREA_LCD 1
+#define TAREA_BARRA 2
+#define SCHED_TASKS 3
+#include "sched.c" // planificador cooperativo con tick de 1ms en el Timer0
+#define EVLOG_TIME() sched_now() // registro de eventos y latencias en ms
+#define USB_PM_TIME() sched_now()
+
 #include <pic18_usb.h> // Microchip PIC18Fxx5x Hardware layer for CCS's PIC USB driver
 #include "header.h" // Configuracin del USB y los descriptores para este dispositivo
+#include "evlog.c" // registro circular de eventos (antes de usb.c y LCD416.c para sus ganchos)
+#include "usb_pm.h" // ganchos de suspension/reanudacion del USB
+
+#define UART_BAUD 1000000 //velocidad del enlace con el PIC B
+#include "uart_baud.h" //calcula SPBRG para UART_BAUD, error de compilacion si no se alcanza
+#use rs232(uart1,baud=UART_BAUD,xmit=PIN_C6,rcv=PIN_C7,bits=8,parity=N)
+#define UART_TX_SIZE 64 //dos paquetes del EndPoint 1
+#define UART_RX_SIZE 64
+#include "uart_tx.c" // cola de transmision vaciada por #int_TBE
+#include "uart_rx.c" // cola de recepcion llenada por #int_RDA
 
 #include <usb.c> // handles usb setup tokens and get descriptor reports
+#define use_lcd_fb // copia del lcd en RAM, solo se envian los caracteres que cambian
+#define use_lcd_async // el lcd se escribe desde la interrupcion del Timer2, lcd_putc no espera
+//#define use_lcd_rw true // R/W del lcd en D2 (sin use_lcd_async): espera la bandera de ocupado en vez de retardos fijos
 #include "LCD416.c"
+#include "lcd_fmt.c" // numeros de ancho fijo sin printf (LCD_FMT_PRINTF para comparar)
+#include "lcd_glyph.c" // caracteres propios en la CGRAM y grafico de barra
+#include "usb_pm.c" // bajo consumo mientras el bus USB esta suspendido
+#include "adc_pack.c" // formato compacto para enviar muestras del ADC al PC
+#include "usb_uart.c" // puente EndPoint 1 <-> UART, todo en interrupciones
 #define ComandoPC DatosBuffer[0]
 #define ParametroPC DatosBuffer[1]
 #define TIPO_COMANDO 88
+#define TIPO_ADC 89 // ParametroPC = codificacion (ADC_PACK_RAW10, ADC_PACK_DELTA8, ADC_PACK_DELTA4)
+#define TIPO_LOG 90 // el PC pide el registro de eventos (se envia por el EndPoint 1)
+#define TIPO_PM 91 // el PC pide las estadisticas de suspension (ver usb_pm_report)
+#define TIPO_SCHED 92 // el PC pide el peor tiempo de cada tarea (ver EnviaTiemposTareas)
+#define TIPO_LCDBENCH 93 // mide el tiempo de redibujar todo el lcd (ver BancoLCD)
+#define TIPO_FMTBENCH 94 // mide los ciclos de formatear un numero (ver BancoFormato)
+#define TIPO_PUENTE 95 // pasa el EndPoint 1 a puente con la UART hasta el siguiente reset del bus (ver usb_uart.c)
 #define LCD_ENABLE_PIN PIN_D1
 #define LCD_RS_PIN PIN_D0
 const int8 TamBuffer = 32; //Longitud del Buffer de lectura en el puerto USB.
 
 int8 DatosBuffer[TamBuffer];//arreglo de 32 bytes
 
+//Llena un paquete con muestras de AN0 y lo envia por el EndPoint 1
+void EnviaMuestrasADC(int8 codificacion) {
+   int16 muestra;
+
+   set_adc_channel(0);
+   delay_us(10);
+   adc_pack_begin(codificacion, read_adc());
+   do {
+      muestra = read_adc();
+   } while (adc_pack_put(muestra)); //termina cuando el paquete esta lleno o el delta no cabe
+
+   usb_put_packet(1, adc_pack_buf, adc_pack_len(), USB_DTS_TOGGLE);
+}
+
+//Envia por el EndPoint 1: TIPO_SCHED, numero de tareas y por cada tarea
+//el peor tiempo en ciclos de instruccion (lo, hi) y las veces que excedio SCHED_BUDGET
+void EnviaTiemposTareas(void) {
+   int8 i, n;
+
+   DatosBuffer[0] = TIPO_SCHED;
+   DatosBuffer[1] = SCHED_TASKS;
+   n = 2;
+   for (i = 0; i < SCHED_TASKS; i++) {
+      DatosBuffer[n++] = make8(sched_wcet[i],0);
+      DatosBuffer[n++] = make8(sched_wcet[i],1);
+      DatosBuffer[n++] = sched_overruns[i];
+   }
+   usb_put_packet(1, DatosBuffer, n, USB_DTS_TOGGLE);
+}
+
+int8 ValorLCD; //ultimo valor recibido con TIPO_COMANDO
+int1 MostrarLCD; //hay un valor nuevo que mostrar
+
+//Redibuja las 4 lineas del lcd (64 caracteres con lcd_putc) y envia por el EndPoint 1:
+//TIPO_LCDBENCH, modo (0 = retardos fijos, 1 = bandera de ocupado, 2 = bandera sin respuesta,
+//3 = cola con interrupcion), los ciclos de instruccion que el programa estuvo en lcd_putc
+//y los ciclos hasta que el lcd termino (4 bytes cada uno, el menos significativo primero)
+void BancoLCD(void) {
+   int8 x, y;
+   int32 inicio, ciclos, total;
+
+  #ifdef use_lcd_async
+   lcd_wait();
+  #endif
+   inicio = sched_cycles32();
+   for (y = 1; y <= 4; y++) {
+      lcd_gotoxy(1, y);
+      for (x = 0; x < 16; x++)
+         lcd_putc('0' + ((x + y) & 7));
+   }
+   ciclos = sched_cycles32() - inicio;
+  #ifdef use_lcd_async
+   lcd_wait();
+  #endif
+   total = sched_cycles32() - inicio;
+
+   lcd_fb_refresh(); //el lcd ya no coincide con la copia en RAM
+   MostrarLCD = TRUE;
+
+   DatosBuffer[0] = TIPO_LCDBENCH;
+  #if defined(use_lcd_rw)
+   DatosBuffer[1] = lcd_busy_ok ? 1 : 2;
+  #elif defined(use_lcd_async)
+   DatosBuffer[1] = 3;
+  #else
+   DatosBuffer[1] = 0;
+  #endif
+   DatosBuffer[2] = make8(ciclos,0);
+   DatosBuffer[3] = make8(ciclos,1);
+   DatosBuffer[4] = make8(ciclos,2);
+   DatosBuffer[5] = make8(ciclos,3);
+   DatosBuffer[6] = make8(total,0);
+   DatosBuffer[7] = make8(total,1);
+   DatosBuffer[8] = make8(total,2);
+   DatosBuffer[9] = make8(total,3);
+   usb_put_packet(1, DatosBuffer, 10, USB_DTS_TOGGLE);
+}
+
+//Formatea 16 valores con cada formateador de lcd_fmt.c en la linea 4 del framebuffer
+//y envia por el EndPoint 1: TIPO_FMTBENCH, implementacion (0 = tablas, 1 = printf)
+//y los ciclos de instruccion por valor de lcd_fmt_u8, lcd_fmt_dec(,5), lcd_fmt_fix(,4,2)
+//y lcd_fmt_hex4 (2 bytes cada uno, el menos significativo primero)
+void BancoFormato(void) {
+   int8 i, j, n;
+   int16 v;
+   int32 inicio, ciclos;
+
+   n = 2;
+   for (i = 0; i < 4; i++) {
+      inicio = sched_cycles32();
+      v = 0;
+      for (j = 0; j < 16; j++, v += 4093) { //valores de 1 a 5 cifras
+         lcd_fb_gotoxy(1,4);
+         switch (i) {
+            case 0: lcd_fmt_u8(make8(v,0)); break;
+            case 1: lcd_fmt_dec(v,5); break;
+            case 2: lcd_fmt_fix(v,4,2); break;
+            case 3: lcd_fmt_hex4(v); break;
+         }
+      }
+      ciclos = (sched_cycles32() - inicio) / 16;
+      DatosBuffer[n++] = make8(ciclos,0);
+      DatosBuffer[n++] = make8(ciclos,1);
+   }
+
+   lcd_fb_gotoxy(1,4); //borra lo que quedo en la linea 4
+   for (i = 0; i < 16; i++)
+      lcd_fb_putc(' ');
+   MostrarLCD = TRUE;
+
+   DatosBuffer[0] = TIPO_FMTBENCH;
+  #ifdef LCD_FMT_PRINTF
+   DatosBuffer[1] = 1;
+  #else
+   DatosBuffer[1] = 0;
+  #endif
+   usb_put_packet(1, DatosBuffer, n, USB_DTS_TOGGLE);
+}
+
+//Tarea USB: atiende un comando del PC por pasada, sin bloquear
+void TareaUSB(void) {
+   usb_pm_task(); //duerme mientras el bus USB esta suspendido
+   if(usb_uart_on) //en modo puente el EndPoint 1 lo atienden las interrupciones
+      return;
+   if(evlog_drain_task()) //el registro de eventos sale de a un paquete por pasada
+      return;
+   if(!usb_enumerated() || !usb_kbhit(1)) //si el PicUSB no esta configurado o no hay datos del PC
+      return;
+
+   usb_get_packet(1, DatosBuffer, TamBuffer); //cogemos el paquete de tamao 32 bytes(TamBuffer) del EndPoint 1 y Toma los dos bytes 
+                                 //que llegan y los guarda en DatosBuffer,y luego son guardos en ComandoPC y ParametroPC respectivamente
+   evlog(EV_CMD, ComandoPC, ParametroPC);
+   usb_pm_command(); //mide la latencia reanudacion -> primer comando
+
+   if(ComandoPC==TIPO_COMANDO){ //Verifica si el byte 0 (RecCommad) que llega es igual a TIPO_COMANDO = 88
+      ValorLCD = ParametroPC; //la tarea LCD lo imprime
+      MostrarLCD = TRUE;
+   }
+   else if(ComandoPC==TIPO_ADC){ //El PC pide un paquete de muestras del ADC
+      EnviaMuestrasADC(ParametroPC);
+   }
+   else if(ComandoPC==TIPO_LOG){ //El PC pide el registro de eventos
+      evlog_drain(1);
+   }
+   else if(ComandoPC==TIPO_PM){ //El PC pide las estadisticas de suspension
+      usb_pm_report(&DatosBuffer[1]);
+      usb_put_packet(1, DatosBuffer, 7, USB_DTS_TOGGLE);
+   }
+   else if(ComandoPC==TIPO_SCHED){ //El PC pide los tiempos de las tareas
+      EnviaTiemposTareas();
+   }
+   else if(ComandoPC==TIPO_LCDBENCH){ //El PC pide medir el lcd
+      BancoLCD();
+   }
+   else if(ComandoPC==TIPO_FMTBENCH){ //El PC pide medir el formateo de numeros
+      BancoFormato();
+   }
+   else if(ComandoPC==TIPO_PUENTE){ //El PC pide el puente con la UART
+      usb_uart_report(&DatosBuffer[1]); //estadisticas de la sesion anterior
+      usb_put_packet(1, DatosBuffer, 21, USB_DTS_TOGGLE);
+      usb_uart_start(); //lo siguiente que llegue al EndPoint 1 sale por la UART
+   }
+}
+
+//Tarea LCD: imprime el ultimo valor recibido, como maximo uno por periodo
+void TareaLCD(void) {
+   if (!MostrarLCD)
+      return;
+   MostrarLCD = FALSE;
+   lcd_fb_gotoxy(1,1) ;
+   lcd_fmt_u8(ValorLCD);     //imprimimos en el lcd el valor de ParametroPC (0 a 255, 3 columnas)
+   lcd_flush(); //envia al lcd solo los digitos que cambiaron
+}
+
+//Tarea barra: muestra la entrada AN0 en la linea 2, barra de 12 caracteres y valor
+void TareaBarra(void) {
+   int16 muestra;
+
+   set_adc_channel(0);
+   muestra = read_adc();
+   lcd_bar(1, 2, 12, muestra, 1023);
+   lcd_fb_gotoxy(13,2);
+   lcd_fmt_dec(muestra,4);
+   lcd_flush();
+}
+
 void main(void) {
 
+  evlog(EV_BOOT, 0, 0);
+   setup_adc_ports(AN0|VSS_VDD); //antes de lcd_init: PBADEN deja RB0-RB4 analogicos (bus de 8 bits)
   lcd_init();//inicializamos el lcd
   
-   setup_adc_ports(AN0|VSS_VDD);
    setup_adc(ADC_CLOCK_DIV_8);
    setup_spi(SPI_SS_DISABLED);
    setup_wdt(WDT_OFF);
-   setup_timer_0(RTCC_INTERNAL);
-   setup_timer_1(T1_DISABLED);
-   setup_timer_2(T2_DISABLED,0,1);
+   sched_init(); //Timer0: tick de 1ms, Timer1: contador de ciclos
+   //el Timer2 lo usa LCD416.c (use_lcd_async)
    setup_ccp1(CCP_OFF);
    setup_comparator(NC_NC_NC_NC);
+   uart_baud_setup(); //SPBRG calculado en uart_baud.h
+   enable_interrupts(INT_RDA); //fuera del modo puente los bytes recibidos se descartan
  
    set_tris_d(0x00);
    lcd_gotoxy(1,1) ;
@@ -51,21 +274,14 @@ void main(void) {
    usb_task(); //Se encarga de mantener el  sentido de la comunicacin, llama a usb_detach() yusb_attach() cuando se necesita
    usb_wait_for_enumeration(); // Esperamos hasta que el PicUSB sea configurado por el host
    enable_interrupts(global); // Habilitamos todas las interrupciones
+
+   sched_every(TAREA_USB, 0); //en cada pasada
+   sched_every(TAREA_LCD, 100); //cada 100ms
+   sched_every(TAREA_BARRA, 200); //cada 200ms
  
  while (TRUE){
-    if(usb_enumerated()){ //si el PicUSB est configurado
-      if (usb_kbhit(1)){//Verifica si se han recibido datos provenientes del PC
-      
-         usb_get_packet(1, DatosBuffer, TamBuffer); //cogemos el paquete de tamao 32 bytes(TamBuffer) del EndPoint 1 y Toma los dos bytes 
-                                       //que llegan y los guarda en DatosBuffer,y luego son guardos en ComandoPC y ParametroPC respectivamente
-        
-         if(ComandoPC==TIPO_COMANDO){ //Verifica si el byte 0 (RecCommad) que llega es igual a TIPO_COMANDO = 88
-         printf(LCD_PUTC,"%d",ParametroPC);     //imprimimos en el lcd el valor de ParametroPC desde el byte 1 (DatosBuffer)
-         delay_ms(1000);
-         lcd_gotoxy(1,1) ;
-         
-        }
-      }
-    }
+    SCHED_RUN(TAREA_USB, TareaUSB());
+    SCHED_RUN(TAREA_LCD, TareaLCD());
+    SCHED_RUN(TAREA_BARRA, TareaBarra());
   }
 }
@@ -258,6 +258,30 @@ struct
 //#define debug_usb printf
 //#define debug_putc putc_tbe
 #define debug_display_ram(x,y)
+
+//event log hook, see evlog.c
+#ifndef usb_evlog
+ #define usb_evlog(id,a,b)
+#endif
+
+//suspend/resume hooks, see usb_pm.h
+#ifndef usb_on_suspend
+ #define usb_on_suspend()
+#endif
+#ifndef usb_on_resume
+ #define usb_on_resume()
+#endif
+
+//bus reset and EP1-EP15 token done hooks, see usb_uart.h
+#ifndef usb_on_reset
+ #define usb_on_reset()
+#endif
+#ifndef usb_on_out
+ #define usb_on_out(en)
+#endif
+#ifndef usb_on_in
+ #define usb_on_in(en)
+#endif
 /*
 void debug_display_ram(int8 len, int8 *ptr) {
    int8 max=16;
@@ -836,6 +860,8 @@ void usb_set_configured(int8 config)
    int16 len;
    int8 i;
    
+   usb_evlog(EV_USB_CONFIG, config, 0);
+
    if (config == 0)
    {
       // if config=0 then set addressed state
@@ -993,6 +1019,8 @@ void usb_isr_sof(void)
 void usb_isr_rst(void) 
 {
    debug_usb(debug_putc,"R");
+   usb_evlog(EV_USB_RESET, 0, 0);
+   usb_on_reset();
 
    UEIR = 0;
    UIR = 0;
@@ -1054,6 +1082,7 @@ void usb_isr_uerr(void)
   #endif
 
    debug_usb(debug_putc,"E %X ",UEIR);
+   usb_evlog(EV_USB_ERROR, UEIR, 0);
 
   #if USB_USE_ERROR_COUNTER
    ints=UEIR & UEIE; //mask off the flags with the ones that are enabled
@@ -1116,6 +1145,7 @@ void usb_isr_uerr(void)
 void usb_isr_uidle(void)
 {
    debug_usb(debug_putc, "I");
+   usb_evlog(EV_USB_SUSPEND, 0, 0);
 
    UIE_ACTV = 1;   //enable activity interrupt flag. (we are now suspended until we get an activity interrupt. nice)
    
@@ -1123,6 +1153,8 @@ void usb_isr_uidle(void)
    UIR &= ~(1 << BIT_IDLE);
    
    UCON_SUSPND = 1; //set suspend. we are now suspended
+
+   usb_on_suspend();
 }
 
 
@@ -1136,6 +1168,7 @@ void usb_isr_uidle(void)
 void usb_isr_activity(void)
 {
    debug_usb(debug_putc, "A");
+   usb_evlog(EV_USB_RESUME, 0, 0);
 
    UCON_SUSPND = 0; //turn off low power suspending
    UIE_ACTV = 0; //clear activity interupt enabling
@@ -1145,6 +1178,8 @@ void usb_isr_activity(void)
       //UIR_ACTV = 0;
       UIR &= ~(1 << BIT_ACTV);
    }
+
+   usb_on_resume();
 }
 
 /******************************************************************************
@@ -1156,6 +1191,7 @@ void usb_isr_activity(void)
 void usb_isr_stall(void) 
 {
    debug_usb(debug_putc, "S");
+   usb_evlog(EV_USB_STALL, UEP(0), 0);
    
    
    if (bit_test(UEP(0),0)) 
@@ -1266,11 +1302,13 @@ void usb_isr_tok_dne(void)
       {
          EP_BDxST_O(en) = EP_BDxST_O(en) & 0x43;   //clear up any BDSTAL confusion
          usb_isr_tok_out_dne(en);
+         usb_on_out(en);
       }
       else 
       {
          EP_BDxST_I(en) = EP_BDxST_I(en) & 0x43;   //clear up any BDSTAL confusion
          usb_isr_tok_in_dne(en);
+         usb_on_in(en);
       }
    }
 }
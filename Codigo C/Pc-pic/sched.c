@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////
+////                              SCHED.C                               ////
+////        Cooperative task scheduler on a 1ms Timer0 tick             ////
+////                                                                    ////
+////  sched_init()          Starts Timer0 as the 1ms tick and Timer1    ////
+////                        as a free running instruction cycle         ////
+////                        counter.  Enables interrupts.  Replaces     ////
+////                        setup_timer_0()/setup_timer_1().            ////
+////                                                                    ////
+////  sched_every(id,ms)    Sets the period of task id (0 = run on      ////
+////                        every pass of the main loop).               ////
+////                                                                    ////
+////  SCHED_RUN(id,call)    Runs call if task id is due and records     ////
+////                        its run time.  The main loop is a list of   ////
+////                        these; tasks must return quickly and keep   ////
+////                        their own state between calls.              ////
+////                                                                    ////
+////  sched_now()           Milliseconds since sched_init(), wraps      ////
+////                        every 65.5s.                                ////
+////                                                                    ////
+////  sched_cycles()        Instruction cycle counter (Timer1).         ////
+////                                                                    ////
+////  sched_cycles32()      Instruction cycles since sched_init(), for  ////
+////                        timing anything longer than Timer1 spans.   ////
+////                                                                    ////
+////  sched_wcet[id]        Worst run time of each task in instruction  ////
+////                        cycles, 0xFFFF if it did not fit Timer1.    ////
+////  sched_overruns[id]    Runs longer than SCHED_BUDGET cycles.       ////
+////                                                                    ////
+////  Define SCHED_TASKS (number of tasks) before including.            ////
+////                                                                    ////
+////  sched_on_tick() can be defined before including to run more work  ////
+////  in the tick interrupt (usb_uart.c does); keep it short.           ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef SCHED_TASKS
+#error Define SCHED_TASKS before including sched.c
+#endif
+
+// Timer0 counts instruction cycles (Fosc/4) in 16 bit mode
+#define SCHED_TICK_COUNTS (getenv("CLOCK") / 4000)
+#define SCHED_RELOAD      (65536 - SCHED_TICK_COUNTS)
+
+// Timer1 wraps after this many ticks; longer runs saturate sched_wcet
+#define SCHED_T1_WRAP_MS  (65536 / SCHED_TICK_COUNTS)
+
+#ifndef SCHED_BUDGET
+#define SCHED_BUDGET      SCHED_TICK_COUNTS     // one tick
+#endif
+
+int16 sched_ticks;
+int16 sched_period[SCHED_TASKS];
+int16 sched_next[SCHED_TASKS];
+int16 sched_wcet[SCHED_TASKS];
+int8  sched_overruns[SCHED_TASKS];
+
+#bit SCHED_TMR0IF = 0xFF2.2
+
+#ifndef sched_on_tick
+#define sched_on_tick()
+#endif
+
+int16 sched_start_cycles;
+int16 sched_start_ticks;
+
+#int_timer0
+void sched_isr(void) {
+   set_timer0(get_timer0() + SCHED_RELOAD);   // keeps the cycles already elapsed
+   sched_ticks++;
+   sched_on_tick();
+}
+
+// Reads the tick counter without tearing; also safe inside interrupts.
+#inline
+int16 sched_now(void) {
+   int16 t;
+
+   do {
+      t = sched_ticks;
+   } while (make8(t,0) != make8(sched_ticks,0));
+   return(t);
+}
+
+#define sched_cycles() get_timer1()
+
+int32 sched_cycles32(void) {
+   int16 t, c;
+
+   do {
+      t = sched_ticks;
+      c = get_timer0();
+   } while (t != sched_ticks);                // a tick came in between
+   if (SCHED_TMR0IF && c < SCHED_RELOAD)
+      t++;                                    // wrapped, interrupt not served yet
+   return((int32)t * SCHED_TICK_COUNTS + (c - SCHED_RELOAD));
+}
+
+void sched_init(void) {
+   setup_timer_0(RTCC_INTERNAL|RTCC_DIV_1);
+   set_timer0(SCHED_RELOAD);
+   setup_timer_1(T1_INTERNAL|T1_DIV_BY_1);
+   enable_interrupts(INT_TIMER0);
+   enable_interrupts(GLOBAL);
+}
+
+void sched_every(int8 id, int16 ms) {
+   sched_period[id] = ms;
+   sched_next[id] = sched_now() + ms;
+}
+
+int1 sched_due(int8 id) {
+   int16 now;
+
+   if (sched_period[id] == 0)
+      return(TRUE);
+   now = sched_now();
+   if ((signed int16)(now - sched_next[id]) < 0)
+      return(FALSE);
+   sched_next[id] += sched_period[id];
+   // fell more than a period behind: skip the missed runs instead of bursting
+   if ((signed int16)(now - sched_next[id]) >= 0)
+      sched_next[id] = now + sched_period[id];
+   return(TRUE);
+}
+
+void sched_done(int8 id) {
+   int16 run;
+
+   run = sched_cycles() - sched_start_cycles;
+   if (sched_now() - sched_start_ticks >= SCHED_T1_WRAP_MS)
+      run = 0xFFFF;
+   if (run > sched_wcet[id])
+      sched_wcet[id] = run;
+   if (run > SCHED_BUDGET && sched_overruns[id] != 0xFF)
+      sched_overruns[id]++;
+}
+
+#define SCHED_RUN(id, call)                      \
+   if (sched_due(id)) {                          \
+      sched_start_ticks = sched_now();           \
+      sched_start_cycles = sched_cycles();       \
+      call;                                      \
+      sched_done(id);                            \
+   }
@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////
+////                             UART_RX.C                              ////
+////          Interrupt driven UART receive through a ring buffer       ////
+////                                                                    ////
+////  uart_rx_ready()    Bytes waiting in the queue.                    ////
+////                                                                    ////
+////  uart_rx_get()      Oldest byte from the queue.  Call only when    ////
+////                     uart_rx_ready() is not 0.                      ////
+////                                                                    ////
+////  uart_rx_overruns   Times the UART FIFO overflowed (OERR).  The    ////
+////                     receiver is restarted, the bytes that did not  ////
+////                     fit in the FIFO are lost.                      ////
+////                                                                    ////
+////  uart_rx_framing    Bytes with a bad stop bit (FERR), discarded.   ////
+////                                                                    ////
+////  uart_rx_dropped    Bytes lost because the queue was full.         ////
+////                                                                    ////
+////  The #int_RDA handler empties the two byte UART FIFO into the      ////
+////  queue and clears an overrun, which otherwise stops reception      ////
+////  for good.  Include after #use rs232 and do not mix with getc()    ////
+////  on the same UART.  The counters stop at 0xFFFF.                   ////
+////                                                                    ////
+////  Define before including to handle bytes in the interrupt instead  ////
+////  (frame.c does):                                                   ////
+////  uart_rx_sink(c)    TRUE when it took c, FALSE to queue c.         ////
+////  uart_rx_error()    Called when a byte was lost (FERR or OERR).    ////
+////  uart_rx_peek()     Called before each good byte is read, while    ////
+////                     RCSTA still describes it (RX9D, bus9.c).       ////
+////  uart_rx_hold()     With UART_RX_FLOW, TRUE to raise RTS after the ////
+////                     sink took a byte (frame.c: while a frame waits ////
+////                     for the reader).  Call uart_rx_resume() when   ////
+////                     it turns FALSE.                                ////
+////                                                                    ////
+////  UART_RX_FLOW defined before including adds hardware flow control: ////
+////  RB3 is the RTS output (set_tris_b() it), driven high once the     ////
+////  queue holds UART_RX_HIGH bytes and low again when uart_rx_get()   ////
+////  brings it down to UART_RX_LOW.  Wire it to the CTS of the sender  ////
+////  (uart_tx.c); the room above UART_RX_HIGH takes the bytes already  ////
+////  on their way when it stops.  RTS is driven through LATB, not      ////
+////  PORTB, so setting it from the interrupt never copies the level of ////
+////  another RB pin onto that pin's latch.                             ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef UART_RX_SIZE
+#define UART_RX_SIZE 32              // power of 2
+#endif
+
+#byte UART_RCREG = 0xFAE
+#bit  UART_RCIF  = 0xF9E.5           // PIR1: RCREG holds a byte
+#bit  UART_OERR  = 0xFAB.1           // RCSTA: FIFO overrun
+#bit  UART_FERR  = 0xFAB.2           // RCSTA: stop bit of the byte at the top of the FIFO
+#bit  UART_CREN  = 0xFAB.4           // RCSTA: receiver enabled
+
+#ifdef UART_RX_FLOW
+#ifndef UART_RX_HIGH
+#define UART_RX_HIGH (UART_RX_SIZE - 8)
+#endif
+#ifndef UART_RX_LOW
+#define UART_RX_LOW (UART_RX_SIZE / 4)
+#endif
+#bit  UART_RTS   = 0xF8A.3           // LATB: RB3, high while the queue is nearly full
+#endif
+
+BYTE uart_rx_buf[UART_RX_SIZE];
+BYTE uart_rx_head;                   // next free entry, written by the interrupt
+BYTE uart_rx_tail;                   // next byte to read, written by the consumer
+int16 uart_rx_overruns;
+int16 uart_rx_framing;
+int16 uart_rx_dropped;
+
+#define uart_rx_count(n) if (n != 0xFFFF) n++
+
+#ifndef uart_rx_sink
+#define uart_rx_sink(c) FALSE
+#endif
+#ifndef uart_rx_error
+#define uart_rx_error()
+#endif
+#ifndef uart_rx_peek
+#define uart_rx_peek()
+#endif
+#ifndef uart_rx_hold
+#define uart_rx_hold() FALSE
+#endif
+
+#int_RDA
+void uart_rx_isr(void) {
+   BYTE c, next;
+
+   while (UART_RCIF) {
+      if (UART_FERR) {               // FERR belongs to the byte about to be read
+         c = UART_RCREG;
+         uart_rx_count(uart_rx_framing);
+         uart_rx_error();
+         continue;
+      }
+      uart_rx_peek();
+      c = UART_RCREG;
+      if (uart_rx_sink(c)) {
+#ifdef UART_RX_FLOW
+         if (uart_rx_hold())
+            UART_RTS = 1;
+#endif
+         continue;
+      }
+      next = (uart_rx_head + 1) & (UART_RX_SIZE - 1);
+      if (next == uart_rx_tail) {
+         uart_rx_count(uart_rx_dropped);
+      } else {
+         uart_rx_buf[uart_rx_head] = c;
+         uart_rx_head = next;
+#ifdef UART_RX_FLOW
+         if (((next - uart_rx_tail) & (UART_RX_SIZE - 1)) >= UART_RX_HIGH)
+            UART_RTS = 1;
+#endif
+      }
+   }
+   if (UART_OERR) {                  // FIFO is empty now, restart the receiver
+      UART_CREN = 0;
+      UART_CREN = 1;
+      uart_rx_count(uart_rx_overruns);
+      uart_rx_error();
+   }
+}
+
+BYTE uart_rx_ready(void) {
+   return((uart_rx_head - uart_rx_tail) & (UART_RX_SIZE - 1));
+}
+
+#ifdef UART_RX_FLOW
+// RTS low again once the queue is down to UART_RX_LOW and nothing holds it
+void uart_rx_resume(void) {
+   disable_interrupts(INT_RDA);      // it may raise RTS in between
+   if (UART_RTS && !uart_rx_hold() && uart_rx_ready() <= UART_RX_LOW)
+      UART_RTS = 0;
+   enable_interrupts(INT_RDA);
+}
+#endif
+
+BYTE uart_rx_get(void) {
+   BYTE c;
+
+   c = uart_rx_buf[uart_rx_tail];
+   uart_rx_tail = (uart_rx_tail + 1) & (UART_RX_SIZE - 1);
+#ifdef UART_RX_FLOW
+   uart_rx_resume();
+#endif
+   return(c);
+}
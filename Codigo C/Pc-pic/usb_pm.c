@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////
+////                              USB_PM.C                              ////
+////            USB suspend/resume power management                     ////
+////                                                                    ////
+////  usb_pm_task()       Call from the main loop.  While the bus is    ////
+////                      suspended it turns the LCD off, parks its     ////
+////                      pins low and sleeps the CPU.  USB activity    ////
+////                      wakes it; so does the wake button, which      ////
+////                      signals remote wakeup if the host armed it.   ////
+////                                                                    ////
+////  usb_pm_command()    Call when a command arrives.  The first one   ////
+////                      after a resume gives the resume-to-command    ////
+////                      latency, in USB_PM_TIME() ticks.              ////
+////                                                                    ////
+////  usb_pm_report(p)    Writes 6 bytes of statistics to p:            ////
+////                      suspends, remote wakeups, last latency lo/hi, ////
+////                      worst latency lo/hi.                          ////
+////                                                                    ////
+////  Needs usb_pm.h before usb.c, and the remote wakeup bit (0x20) in  ////
+////  the configuration descriptor attributes.                          ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef USB_PM_WAKE_PIN
+#define USB_PM_WAKE_PIN PIN_B4     // active low; RB4-RB7 have interrupt-on-change
+#endif
+
+//#define USB_PM_BACKLIGHT_PIN PIN_xx  // define if the LCD backlight is switched
+
+#ifndef USB_PM_TIME
+#define USB_PM_TIME() get_timer0()
+#endif
+
+#byte USB_PM_PORTB = 0xF81
+
+#if defined(use_lcd_8bit) && LCD_BUS_ADDR == 0xF81
+#error The LCD 8 bit bus is on PORTB, which has the wake button; move LCD_BUS_ADDR
+#endif
+
+int1  usb_pm_suspended;
+int1  usb_pm_measuring;
+int16 usb_pm_resume_time;
+int16 usb_pm_wake_last;
+int16 usb_pm_wake_max;
+int8  usb_pm_suspends;
+int8  usb_pm_remote_wakes;
+
+// called from usb_isr_uidle()
+void usb_pm_isr_suspend(void) {
+   usb_pm_suspended = 1;
+}
+
+// called from usb_isr_activity()
+void usb_pm_isr_resume(void) {
+   usb_pm_suspended = 0;
+   usb_pm_resume_time = USB_PM_TIME();
+   usb_pm_measuring = 1;
+}
+
+// Only here to wake the CPU; reading PORTB ends the mismatch condition.
+#int_rb
+void usb_pm_rb_isr(void) {
+   int8 dummy;
+   dummy = USB_PM_PORTB;
+}
+
+void usb_pm_task(void) {
+   if (!usb_pm_suspended)
+      return;
+
+   usb_pm_suspends++;
+   lcd_send_byte(0, 0x08);          // display off, DDRAM is kept
+  #ifdef use_lcd_async
+   lcd_wait();
+  #endif
+  #ifdef USB_PM_BACKLIGHT_PIN
+   output_low(USB_PM_BACKLIGHT_PIN);
+  #endif
+   lcd.data = 0;
+  #ifdef use_lcd_8bit
+   lcd_bus = 0;
+  #endif
+   lcd.rs = 0;
+   lcd.enable = 0;
+
+   clear_interrupt(INT_RB);
+   enable_interrupts(INT_RB);
+   for (;;) {
+      // GIE off from the test to sleep(): a resume interrupt in between
+      // would clear the flag and leave the CPU asleep on an active bus.
+      // An enabled interrupt that is pending still wakes it.
+      disable_interrupts(GLOBAL);
+      if (!usb_pm_suspended)
+         break;
+      sleep();                      // woken by the USB or port B interrupt
+      delay_cycles(1);
+      enable_interrupts(GLOBAL);    // the interrupt that woke it runs here
+      if (usb_pm_suspended && !input(USB_PM_WAKE_PIN)
+          && bit_test(USB_stack_status.status_device, 1)) {
+         // remote wakeup: drive resume signalling for 1-15ms, the host
+         // then resumes the bus and usb_isr_activity() clears the flag
+         UCON_SUSPND = 0;
+         UCON_RESUME = 1;
+         delay_ms(10);
+         UCON_RESUME = 0;
+         usb_pm_remote_wakes++;
+      }
+   }
+   enable_interrupts(GLOBAL);
+   disable_interrupts(INT_RB);
+
+  #ifdef USB_PM_BACKLIGHT_PIN
+   output_high(USB_PM_BACKLIGHT_PIN);
+  #endif
+   lcd_send_byte(0, LCD_INIT_STRING[1]);   // display back on
+}
+
+void usb_pm_command(void) {
+   if (usb_pm_measuring) {
+      usb_pm_measuring = 0;
+      usb_pm_wake_last = USB_PM_TIME() - usb_pm_resume_time;
+      if (usb_pm_wake_last > usb_pm_wake_max)
+         usb_pm_wake_max = usb_pm_wake_last;
+      usb_evlog(EV_USB_WAKE, make8(usb_pm_wake_last,0), make8(usb_pm_wake_last,1));
+   }
+}
+
+void usb_pm_report(int8 *p) {
+   p[0] = usb_pm_suspends;
+   p[1] = usb_pm_remote_wakes;
+   p[2] = make8(usb_pm_wake_last,0);
+   p[3] = make8(usb_pm_wake_last,1);
+   p[4] = make8(usb_pm_wake_max,0);
+   p[5] = make8(usb_pm_wake_max,1);
+}
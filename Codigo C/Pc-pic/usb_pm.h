@@ -0,0 +1,20 @@
+////////////////////////////////////////////////////////////////////////////
+////                              USB_PM.H                              ////
+////            USB suspend/resume power management hooks               ////
+////                                                                    ////
+////  Include after the descriptors and before usb.c, so the hardware   ////
+////  layer calls usb_pm_isr_suspend() and usb_pm_isr_resume() from     ////
+////  usb_isr_uidle() and usb_isr_activity().  The rest of the module   ////
+////  is in usb_pm.c, which is included after usb.c and LCD416.c.       ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef __USB_PM_H__
+#define __USB_PM_H__
+
+void usb_pm_isr_suspend(void);
+void usb_pm_isr_resume(void);
+
+#define usb_on_suspend() usb_pm_isr_suspend()
+#define usb_on_resume()  usb_pm_isr_resume()
+
+#endif
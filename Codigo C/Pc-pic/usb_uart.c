@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////
+////                             USB_UART.C                             ////
+////          Full duplex bridge between USB EP1 and the UART           ////
+////                                                                    ////
+////  usb_uart_start()    Enters bridge mode: from now on every EP1     ////
+////                      OUT packet goes out the UART and the bytes    ////
+////                      the UART receives come back in EP1 IN         ////
+////                      packets.  EP1 is no longer read by the main   ////
+////                      loop.  A USB bus reset leaves the mode.       ////
+////                                                                    ////
+////  usb_uart_on         TRUE in bridge mode.                          ////
+////                                                                    ////
+////  usb_uart_report(p)  Writes 20 bytes of statistics of the bridge   ////
+////                      session to p, see below.                      ////
+////                                                                    ////
+////  Both directions run in interrupts.  An OUT packet is copied to    ////
+////  the uart_tx.c queue by the USB interrupt if it fits; if not, the  ////
+////  buffer stays with the CPU, the host gets NAK, and #int_TBE takes  ////
+////  the packet as soon as the queue has room for it.  Received bytes  ////
+////  are written by #int_RDA straight into the EP1 IN buffer, which    ////
+////  is sent when full (USB_EP1_TX_SIZE bytes) or when no byte came    ////
+////  for USB_UART_FLUSH_MS ticks of sched.c.  While the host has not   ////
+////  collected the previous packet they wait in the uart_rx.c queue.   ////
+////                                                                    ////
+////  Needs usb_uart.h before sched.c, uart_tx.c, uart_rx.c and usb.c.  ////
+////  Make UART_TX_SIZE at least twice USB_EP1_RX_SIZE so one packet    ////
+////  fits while the previous one drains.                               ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef USB_UART_FLUSH_MS
+#define USB_UART_FLUSH_MS 1          // ticks without a byte before a short IN packet is sent
+#endif
+
+#if UART_TX_SIZE < 2 * USB_EP1_RX_SIZE
+#error UART_TX_SIZE too small for the USB to UART bridge
+#endif
+
+int1  usb_uart_on;
+int1  usb_uart_held;                 // an OUT packet waits for room in the queue
+BYTE  usb_uart_in_len;               // bytes in the EP1 IN buffer, not yet sent
+BYTE  usb_uart_idle;                 // ticks since the last of them arrived
+
+int32 usb_uart_out_bytes;            // to the UART
+int32 usb_uart_in_bytes;             // to the PC
+int16 usb_uart_out_waits;            // OUT packets that had to wait for room
+int16 usb_uart_in_full;              // IN packets sent full
+int16 usb_uart_in_flushed;           // IN packets sent by the timeout
+
+#define usb_uart_count(n) if (n != 0xFFFF) n++
+
+// Moves the EP1 OUT packet to the transmit queue and hands the buffer back
+// to the SIE, or leaves it with the CPU (the host gets NAK) until it fits.
+void usb_uart_out(void) {
+   BYTE n;
+
+   n = usb_rx_packet_size(USB_UART_EP);
+   if (uart_tx_free() < n) {
+      if (!usb_uart_held)
+         usb_uart_count(usb_uart_out_waits);
+      usb_uart_held = TRUE;
+      return;
+   }
+   usb_uart_held = FALSE;
+   uart_tx_write(usb_ep1_rx_buffer, n);
+   usb_uart_out_bytes += n;
+   usb_flush_out(USB_UART_EP, USB_DTS_TOGGLE);
+}
+
+// Sends the EP1 IN buffer as it is.
+void usb_uart_flush(void) {
+   usb_flush_in(USB_UART_EP, usb_uart_in_len, USB_DTS_TOGGLE);
+   usb_uart_in_bytes += usb_uart_in_len;
+   usb_uart_in_len = 0;
+}
+
+void usb_uart_isr_out(int8 en) {
+   if (usb_uart_on && en == USB_UART_EP)
+      usb_uart_out();
+}
+
+// The previous IN packet was collected: refill the buffer from the queue.
+void usb_uart_isr_in(int8 en) {
+   if (!usb_uart_on || en != USB_UART_EP)
+      return;
+   while (uart_rx_ready() && usb_uart_in_len < USB_EP1_TX_SIZE)
+      usb_ep1_tx_buffer[usb_uart_in_len++] = uart_rx_get();
+   if (usb_uart_in_len == USB_EP1_TX_SIZE) {
+      usb_uart_count(usb_uart_in_full);
+      usb_uart_flush();
+   }
+}
+
+void usb_uart_isr_reset(void) {
+   usb_uart_on = FALSE;
+   usb_uart_held = FALSE;
+   usb_uart_in_len = 0;
+}
+
+void usb_uart_isr_tick(void) {
+   if (usb_uart_in_len == 0 || ++usb_uart_idle < USB_UART_FLUSH_MS)
+      return;
+   usb_uart_count(usb_uart_in_flushed);
+   usb_uart_flush();
+}
+
+void usb_uart_isr_refill(void) {
+   if (usb_uart_held)
+      usb_uart_out();
+}
+
+// TRUE when c was taken; FALSE queues it in uart_rx.c.
+int1 usb_uart_isr_rx(BYTE c) {
+   if (!usb_uart_on)
+      return(TRUE);                  // outside the bridge nobody reads them
+   if (!usb_tbe(USB_UART_EP) || uart_rx_ready())
+      return(FALSE);                 // behind the packet the host has not collected
+   usb_ep1_tx_buffer[usb_uart_in_len++] = c;
+   usb_uart_idle = 0;
+   if (usb_uart_in_len == USB_EP1_TX_SIZE) {
+      usb_uart_count(usb_uart_in_full);
+      usb_uart_flush();
+   }
+   return(TRUE);
+}
+
+// Starts with empty queues: what PIC B sent before the bridge was on
+// would otherwise reach the PC ahead of the answers to its first packet.
+void usb_uart_start(void) {
+   disable_interrupts(GLOBAL);
+   while (UART_RCIF)                 // the UART FIFO, into the free entry and dropped
+      uart_rx_buf[uart_rx_head] = UART_RCREG;
+   uart_rx_tail = uart_rx_head;      // and the uart_rx.c queue
+  #ifdef UART_RX_FLOW
+   UART_RTS = 0;
+  #endif
+   usb_uart_held = FALSE;
+   usb_uart_in_len = 0;
+   usb_uart_idle = 0;
+   usb_uart_out_bytes = 0;
+   usb_uart_in_bytes = 0;
+   usb_uart_out_waits = 0;
+   usb_uart_in_full = 0;
+   usb_uart_in_flushed = 0;
+   uart_rx_overruns = 0;
+   uart_rx_framing = 0;
+   uart_rx_dropped = 0;
+   usb_uart_on = TRUE;
+   if (usb_kbhit(USB_UART_EP))       // arrived before the bridge was on
+      usb_uart_out();
+   enable_interrupts(GLOBAL);
+}
+
+// Bytes to the UART and to the PC (4 each), OUT packets that waited, IN
+// packets sent full and by the timeout, and the uart_rx.c overruns, framing
+// errors and bytes dropped (2 each), the least significant byte first.
+void usb_uart_report(int8 *p) {
+   p[0] = make8(usb_uart_out_bytes,0);
+   p[1] = make8(usb_uart_out_bytes,1);
+   p[2] = make8(usb_uart_out_bytes,2);
+   p[3] = make8(usb_uart_out_bytes,3);
+   p[4] = make8(usb_uart_in_bytes,0);
+   p[5] = make8(usb_uart_in_bytes,1);
+   p[6] = make8(usb_uart_in_bytes,2);
+   p[7] = make8(usb_uart_in_bytes,3);
+   p[8] = make8(usb_uart_out_waits,0);
+   p[9] = make8(usb_uart_out_waits,1);
+   p[10] = make8(usb_uart_in_full,0);
+   p[11] = make8(usb_uart_in_full,1);
+   p[12] = make8(usb_uart_in_flushed,0);
+   p[13] = make8(usb_uart_in_flushed,1);
+   p[14] = make8(uart_rx_overruns,0);
+   p[15] = make8(uart_rx_overruns,1);
+   p[16] = make8(uart_rx_framing,0);
+   p[17] = make8(uart_rx_framing,1);
+   p[18] = make8(uart_rx_dropped,0);
+   p[19] = make8(uart_rx_dropped,1);
+}
@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////////////////
+////                             USB_UART.H                             ////
+////            Hooks of the USB to UART bridge (usb_uart.c)            ////
+////                                                                    ////
+////  Include before sched.c, uart_tx.c, uart_rx.c and usb.c, so the    ////
+////  Timer0 tick, the UART interrupts and the EP1 token interrupts     ////
+////  reach the bridge.  The rest of the module is in usb_uart.c,       ////
+////  which is included after all of them.                              ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef __USB_UART_H__
+#define __USB_UART_H__
+
+#define USB_UART_EP 1
+
+void usb_uart_isr_out(int8 en);
+void usb_uart_isr_in(int8 en);
+void usb_uart_isr_reset(void);
+void usb_uart_isr_tick(void);
+void usb_uart_isr_refill(void);
+int1 usb_uart_isr_rx(BYTE c);
+
+#define usb_on_out(en)    usb_uart_isr_out(en)
+#define usb_on_in(en)     usb_uart_isr_in(en)
+#define usb_on_reset()    usb_uart_isr_reset()
+#define sched_on_tick()   usb_uart_isr_tick()
+#define uart_tx_refill()  usb_uart_isr_refill()
+#define uart_rx_sink(c)   usb_uart_isr_rx(c)
+
+#endif
@@ -1,10 +1,21 @@
 #include "adclcd.h"
+#define use_lcd_fb // copia del lcd en RAM, solo se envian los caracteres que cambian
+#define use_lcd_async // el lcd se escribe desde la interrupcion del Timer2, lcd_putc no espera
 #include "LCD416.c"
+#include "lcd_fmt.c" // numeros de ancho fijo sin printf
 #define LCD_ENABLE_PIN PIN_D1
 #define LCD_RS_PIN PIN_D0
 
-#fuses xt,nomclr,noprotect,nolvp
-#use rs232(uart1,baud=9600,xmit=PIN_C6,bits=8,parity=N)
+#fuses nomclr //el oscilador lo fija el perfil de reloj de adclcd.h
+#use rs232(uart1,baud=UART_BAUD,xmit=PIN_C6,rcv=PIN_C7,bits=8,parity=N)
+#include "frame.c" // tramas COBS con CRC-16, codificadas en #int_TBE
+#ifdef use_bus9
+#include "bus9.c" // cada trama va precedida de la direccion del nodo (9no bit en 1)
+#endif
+#ifdef use_flow
+#define UART_TX_FLOW // #int_TBE se detiene mientras RB2 (CTS) esta en 1
+#endif
+#include "uart_tx.c" // cola de transmision vaciada por #int_TBE
 #use standard_io(d)
 
 
@@ -15,37 +26,114 @@
 #build(interrupt=0x808)
 #org 0x0000, 0x07ff void bootloader() {}
 
+#define TAREA_BOTON 0 // tareas del planificador (sched.c)
+#define TAREA_UART 1
+#define TAREA_LCD 2
+#define SCHED_TASKS 3
+#include "button.h" // el tick de sched.c termina el antirrebote del boton
+#include "sched.c"
+#include "button.c" // PIN_B5 por interrupcion de cambio en el PORTB, con cola de pulsaciones
+#ifdef use_autobaud
+#include "autobaud.c" //sincronia con Recibe antes de la primera trama
+#endif
+#ifdef use_link
+#define LINK_INITIATOR //Envio propone, Recibe responde
+#include "link.c" //negociacion de velocidad y capacidades con Recibe
+#endif
+
 int boton, x ;
+int1 enviar, mostrar ; // x pendiente de enviar / de mostrar en el lcd
+#ifdef use_link
+int16 abd_ms = 0xFFFF ; // tiempo de autobaud de Recibe ya mostrado en el lcd
+#endif
+
+//Tarea boton: toma la siguiente pulsacion de PIN_B5 de la cola de button.c
+//las que llegan mientras x se envia y se muestra esperan en la cola
+void TareaBoton(void)
+{
+   int16 ms; // momento de la pulsacion, no se usa
+
+   while (!enviar && !mostrar && button_ready()) {
+      boton = button_get(&ms);
+      if (boton == (5 | BUTTON_DOWN)){
+         enviar = TRUE;
+         mostrar = TRUE;
+      }
+   }
+}
+
+//Tarea UART: envia x en una trama, sin esperar
+//si la trama anterior no termino de salir se reintenta en la siguiente pasada
+//en el bus multipunto la trama va a todos los nodos
+void TareaUART(void)
+{
+#ifdef use_autobaud
+   if (!abd_sync_poll()) //envia 0x55 hasta que Recibe confirma la velocidad
+      return;
+#endif
+#ifdef use_link
+   if (!link_poll()) //negocia con Recibe antes del primer valor
+      return;
+#endif
+#ifdef use_bus9
+   if (enviar && bus_send(BUS_BROADCAST, FRAME_T_VALUE, &x, 1))
+#else
+   if (enviar && frame_send(FRAME_T_VALUE, &x, 1))
+#endif
+      enviar = FALSE;
+}
+
+//Tarea LCD: muestra x una vez enviado y pasa al siguiente valor; en la linea 2,
+//los ms que tardo Recibe en medir la velocidad de Envio (su respuesta a la negociacion)
+void TareaLCD(void)
+{
+#ifdef use_link
+   if (link_peer_lock_ms != abd_ms && link_peer_lock_ms != 0xFFFF) { //0xFFFF: Recibe sin autobaud
+      abd_ms = link_peer_lock_ms;
+      lcd_fb_gotoxy(1,2) ;
+      lcd_fmt_dec(abd_ms, 5);
+      lcd_fb_putc('m');
+      lcd_fb_putc('s');
+      lcd_flush();
+   }
+#endif
+   if (!mostrar || enviar)
+      return;
+   mostrar = FALSE;
+   lcd_fb_gotoxy(1,1) ;
+   lcd_fmt_u8(x); //3 columnas, sin printf
+   lcd_flush(); //envia al lcd solo los digitos que cambiaron
+   x++;
+}
+
 void main()
 {
+   setup_adc_ports(NO_ANALOGS|VSS_VDD); //PBADEN deja RB0-RB4 analogicos: RB2 (CTS, INT2) leeria 0
    lcd_init();
-  set_uart_speed(9600);
+   uart_baud_setup(); //SPBRG calculado en uart_baud.h
+#ifdef use_bus9
+   bus_setup(); //modo de 9 bits
+#endif
+#ifdef use_link
+   link_init(); //parte de UART_BAUD, TareaUART negocia
+#endif
    setup_spi(SPI_SS_DISABLED);
    setup_wdt(WDT_OFF);
-   setup_timer_0(RTCC_INTERNAL);
-   setup_timer_1(T1_DISABLED);
-   setup_timer_2(T2_DISABLED,0,1);
+   sched_init(); //Timer0: tick de 1ms, Timer1: contador de ciclos
+   button_init(); //interrupcion de cambio en RB5, antirrebote de 20ms
+   //el Timer2 lo usa LCD416.c (use_lcd_async)
    setup_ccp1(CCP_OFF);
    setup_comparator(NC_NC_NC_NC);
    lcd_gotoxy(1,1) ;
    delay_ms(1000);
    x = 1;
+   sched_every(TAREA_BOTON, 0);
+   sched_every(TAREA_UART, 0);
+   sched_every(TAREA_LCD, 20);
    while(true)
    {     
-   
-   boton = input( PIN_B5 );
-     
-     if (boton==0){
-             putc(x); 
-             printf(LCD_PUTC,"%d",x);    
-        delay_ms(1000);
-         lcd_gotoxy(1,1) ;
-   x++;
-   delay_ms(2000);
-   
-     }
-            
+      SCHED_RUN(TAREA_BOTON, TareaBoton());
+      SCHED_RUN(TAREA_UART, TareaUART());
+      SCHED_RUN(TAREA_LCD, TareaLCD());
    }
 }
-
-
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////
+////                             AUTOBAUD.C                             ////
+////         Link speed measured by the receiver with EUSART ABDEN      ////
+////                                                                    ////
+////  Receiver:                                                         ////
+////  abd_start()        Arms auto-baud detection.  #int_RDA stays off  ////
+////                     until the link is locked.                      ////
+////  abd_poll()         Call until it returns TRUE.  The first sync    ////
+////                     byte (0x55) loads SPBRGH:SPBRG; ABD_CONFIRM    ////
+////                     more must then arrive intact at the new rate,  ////
+////                     otherwise detection starts over.  Once they    ////
+////                     did, ABD_ACK is sent back and #int_RDA is      ////
+////                     enabled.                                       ////
+////  abd_lock_us()      Time from abd_start() to the lock.             ////
+////  abd_retries        Measurements rejected (bad sync, framing       ////
+////                     error, overrun or timeout).                    ////
+////  abd_overflows      Measurements too slow for the 16 bit counter.  ////
+////                                                                    ////
+////  Sender:                                                           ////
+////  abd_sync_poll()    Call often until it returns TRUE.  Sends a     ////
+////                     sync byte every ms and watches for ABD_ACK,    ////
+////                     then sends a 0x00 so the receiver's frame      ////
+////                     decoder starts clean.  Writes TXREG itself:    ////
+////                     queue nothing before it returns TRUE.          ////
+////                                                                    ////
+////  Call uart_baud_setup() before either: the receiver measures with  ////
+////  the BRG16/BRGH mode set there.  Uses sched.c for time.            ////
+////////////////////////////////////////////////////////////////////////////
+
+#define ABD_SYNC     0x55            // start bit plus 0x55 gives the 5 rising edges ABD counts
+#define ABD_ACK      0x06
+
+#ifndef ABD_CONFIRM
+#define ABD_CONFIRM  2
+#endif
+#define ABD_TIMEOUT  20              // ms to wait for each confirmation byte
+
+#byte ABD_RCREG  = 0xFAE
+#byte ABD_TXREG  = 0xFAD
+#bit  ABD_TXIF   = 0xF9E.4
+#bit  ABD_RCIF   = 0xF9E.5
+#bit  ABD_TRMT   = 0xFAC.1
+#bit  ABD_OERR   = 0xFAB.1
+#bit  ABD_FERR   = 0xFAB.2
+#bit  ABD_CREN   = 0xFAB.4
+#bit  ABD_ABDEN  = 0xFB8.0           // BAUDCON
+#bit  ABD_ABDOVF = 0xFB8.7
+
+#define ABD_MEASURE 0
+#define ABD_CHECK   1
+#define ABD_LOCKED  2
+
+BYTE abd_state;
+BYTE abd_good;
+int16 abd_deadline;
+int32 abd_start_cycles;
+int32 abd_lock_cycles;
+int16 abd_retries;
+int16 abd_overflows;
+
+#define abd_lock_us() (abd_lock_cycles * 4 / (getenv("CLOCK") / 1000000))
+
+void abd_arm(void) {
+   while (ABD_RCIF)
+      abd_good = ABD_RCREG;          // what came before, dropped; abd_good is cleared below
+   if (ABD_OERR) {
+      ABD_CREN = 0;
+      ABD_CREN = 1;
+   }
+   ABD_ABDOVF = 0;
+   abd_good = 0;
+   abd_state = ABD_MEASURE;
+   ABD_ABDEN = 1;
+}
+
+void abd_retry(void) {
+   if (abd_retries != 0xFFFF)
+      abd_retries++;
+   abd_arm();
+}
+
+void abd_start(void) {
+   disable_interrupts(INT_RDA);
+   abd_retries = 0;
+   abd_overflows = 0;
+   abd_start_cycles = sched_cycles32();
+   abd_arm();
+}
+
+int1 abd_poll(void) {
+   BYTE c;
+
+   if (abd_state == ABD_LOCKED)
+      return(TRUE);
+   if (abd_state == ABD_MEASURE) {
+      if (ABD_ABDOVF) {
+         if (abd_overflows != 0xFFFF)
+            abd_overflows++;
+         abd_arm();
+         return(FALSE);
+      }
+      if (ABD_ABDEN || !ABD_RCIF)
+         return(FALSE);
+      c = ABD_RCREG;                 // clears RCIF, the byte itself is meaningless
+      abd_state = ABD_CHECK;
+      abd_deadline = sched_now() + ABD_TIMEOUT;
+      return(FALSE);
+   }
+   if (ABD_OERR) {
+      abd_retry();
+      return(FALSE);
+   }
+   if (!ABD_RCIF) {
+      if ((signed int16)(sched_now() - abd_deadline) >= 0)
+         abd_retry();
+      return(FALSE);
+   }
+   if (ABD_FERR) {
+      abd_retry();
+      return(FALSE);
+   }
+   c = ABD_RCREG;
+   if (c != ABD_SYNC) {
+      abd_retry();
+      return(FALSE);
+   }
+   abd_deadline = sched_now() + ABD_TIMEOUT;
+   if (++abd_good < ABD_CONFIRM)
+      return(FALSE);
+   ABD_TXREG = ABD_ACK;
+   abd_lock_cycles = sched_cycles32() - abd_start_cycles;
+   abd_state = ABD_LOCKED;
+#ifdef uart_rx_error
+   uart_rx_error();                  // frame.c: ignore the syncs still coming, up to the 0x00
+#endif
+   enable_interrupts(INT_RDA);
+   return(TRUE);
+}
+
+int1 abd_sync_poll(void) {
+   BYTE c;
+
+   if (abd_state == ABD_LOCKED)
+      return(TRUE);
+   if (ABD_OERR) {
+      ABD_CREN = 0;
+      ABD_CREN = 1;
+   }
+   while (ABD_RCIF && ABD_TXIF) {   // room for the 0x00 before taking the ACK
+      c = ABD_RCREG;
+      if (c == ABD_ACK) {
+         ABD_TXREG = 0;
+         abd_state = ABD_LOCKED;
+         return(TRUE);
+      }
+   }
+   if (ABD_TRMT && (signed int16)(sched_now() - abd_deadline) >= 0) {
+      ABD_TXREG = ABD_SYNC;
+      abd_deadline = sched_now() + 1;
+   }
+   return(FALSE);
+}
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////
+////                              BUTTON.C                              ////
+////      Push buttons on RB4-RB7 by interrupt-on-change, debounced     ////
+////                                                                    ////
+////  button_init()      Takes the current level of the pins as the     ////
+////                     resting one and enables INT_RB.  Call after    ////
+////                     sched_init().                                  ////
+////                                                                    ////
+////  button_ready()     Events waiting in the queue.                   ////
+////                                                                    ////
+////  button_get(&ms)    Oldest event from the queue: the RB pin number ////
+////                     (4 to 7), plus BUTTON_DOWN when it went low.   ////
+////                     ms gets sched_now() at the edge.  Call only    ////
+////                     when button_ready() is not 0.                  ////
+////                                                                    ////
+////  button_lost        Events dropped because the queue was full      ////
+////                     (stops at 0xFFFF).                             ////
+////                                                                    ////
+////  The #int_RB handler reports the first edge of a pin at once and   ////
+////  then ignores the pin for BUTTON_DEBOUNCE_MS ticks of sched.c,     ////
+////  while its contacts bounce.  When that time is over the pin is     ////
+////  read again, so a press shorter than it still gets its release.    ////
+////  BUTTON_PINS selects the pins (default RB5).  Needs button.h       ////
+////  before sched.c; reads PORTB, so nothing else may use RB4-RB7 as   ////
+////  an interrupt-on-change source.                                    ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef BUTTON_PINS
+#define BUTTON_PINS 0x20             // RB5
+#endif
+#ifndef BUTTON_DEBOUNCE_MS
+#define BUTTON_DEBOUNCE_MS 20
+#endif
+#ifndef BUTTON_EVENTS
+#define BUTTON_EVENTS 8              // power of 2
+#endif
+
+#define BUTTON_DOWN 0x80
+
+#byte BUTTON_PORTB = 0xF81
+
+BYTE button_state;                   // debounced level of the pins
+BYTE button_busy;                    // pins inside their debounce time
+BYTE button_left[4];                 // ticks left of it, RB4-RB7
+BYTE button_code[BUTTON_EVENTS];
+int16 button_ms[BUTTON_EVENTS];
+BYTE button_head;                    // next free entry, written by the interrupts
+BYTE button_tail;                    // next event to read, written by the consumer
+int16 button_lost;
+
+// Takes the edges of the pins that are not bouncing from a PORTB reading.
+void button_scan(BYTE p) {
+   BYTE changed, bit, i, next;
+
+   changed = (p ^ button_state) & BUTTON_PINS & ~button_busy;
+   bit = 0x10;
+   for (i = 0; i < 4; i++, bit <<= 1) {
+      if (!(changed & bit))
+         continue;
+      button_state ^= bit;
+      button_busy |= bit;
+      button_left[i] = BUTTON_DEBOUNCE_MS;
+      next = (button_head + 1) & (BUTTON_EVENTS - 1);
+      if (next == button_tail) {
+         if (button_lost != 0xFFFF)
+            button_lost++;
+         continue;
+      }
+      button_code[button_head] = (i + 4) | ((p & bit) ? 0 : BUTTON_DOWN);
+      button_ms[button_head] = sched_now();
+      button_head = next;
+   }
+}
+
+#int_RB
+void button_isr(void) {
+   button_scan(BUTTON_PORTB);        // reading PORTB ends the mismatch
+}
+
+void button_tick(void) {
+   BYTE bit, i, done;
+
+   if (!button_busy)
+      return;
+   done = 0;
+   bit = 0x10;
+   for (i = 0; i < 4; i++, bit <<= 1)
+      if ((button_busy & bit) && --button_left[i] == 0)
+         done |= bit;
+   if (done) {
+      button_busy &= ~done;
+      button_scan(BUTTON_PORTB);     // the level they settled at
+   }
+}
+
+void button_init(void) {
+   disable_interrupts(INT_RB);
+   button_state = BUTTON_PORTB & BUTTON_PINS;
+   button_busy = 0;
+   clear_interrupt(INT_RB);
+   enable_interrupts(INT_RB);
+}
+
+BYTE button_ready(void) {
+   return((button_head - button_tail) & (BUTTON_EVENTS - 1));
+}
+
+BYTE button_get(int16 *ms) {
+   BYTE c;
+
+   c = button_code[button_tail];
+   *ms = button_ms[button_tail];
+   button_tail = (button_tail + 1) & (BUTTON_EVENTS - 1);
+   return(c);
+}
@@ -0,0 +1,17 @@
+////////////////////////////////////////////////////////////////////////////
+////                              BUTTON.H                              ////
+////              Hook of the debounced buttons (button.c)              ////
+////                                                                    ////
+////  Include before sched.c so the Timer0 tick ends the debounce time  ////
+////  of each pin.  The rest of the module is in button.c, which is     ////
+////  included after sched.c.                                           ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BUTTON_H__
+#define __BUTTON_H__
+
+void button_tick(void);
+
+#define sched_on_tick()   button_tick()
+
+#endif
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////
+////                             LCD_FMT.C                              ////
+////        Fixed width number formatting for LCD416.C, no printf       ////
+////                                                                    ////
+////  lcd_fmt_u8(v)        int8 in 3 columns, right aligned             ////
+////  lcd_fmt_dec(v,w)     int16 in w columns (1 to 5)                  ////
+////  lcd_fmt_sdec(v,w)    signed int16 in w columns, sign included     ////
+////                       (2 to 6)                                     ////
+////  lcd_fmt_fix(v,w,f)   int16 as fixed point with f decimals: w      ////
+////                       digit columns plus the point (w > f), so     ////
+////                       lcd_fmt_fix(1234,4,2) shows 12.34            ////
+////  lcd_fmt_hex2(v)      int8 as 2 hex digits                         ////
+////  lcd_fmt_hex4(v)      int16 as 4 hex digits                        ////
+////                                                                    ////
+////  Leading zeros are shown as spaces.  A value that does not fit     ////
+////  its columns is shown as '*'s, the width never changes.  w and f   ////
+////  must be constants; the macros turn them into the column and       ////
+////  point positions at compile time.  Use the macros as statements.   ////
+////                                                                    ////
+////  Digits come from subtracting 10000, 1000 and 100 (at most 24      ////
+////  steps) and a 100 entry BCD table for the last two; no division.   ////
+////  The characters go to LCD_FMT_PUTC(c): straight into the           ////
+////  framebuffer with use_lcd_fb, else to lcd_send_byte() (the queue   ////
+////  with use_lcd_async).                                              ////
+////                                                                    ////
+////  With LCD_FMT_PRINTF defined the same macros call printf() with    ////
+////  the equivalent format, to compare ROM (.sta) and cycles.          ////
+////                                                                    ////
+////  Include after LCD416.c.                                           ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifdef LCD_FMT_PRINTF
+
+#ifdef use_lcd_fb
+#define LCD_FMT_SINK lcd_fb_putc
+#else
+#define LCD_FMT_SINK lcd_putc
+#endif
+
+#define lcd_fmt_u8(v)       printf(LCD_FMT_SINK, "%3u", (BYTE)(v))
+#define lcd_fmt_dec(v,w)    printf(LCD_FMT_SINK, "%" #w "Lu", (int16)(v))
+#define lcd_fmt_sdec(v,w)   printf(LCD_FMT_SINK, "%" #w "Ld", (signed int16)(v))
+#define lcd_fmt_fix(v,w,f)  printf(LCD_FMT_SINK, "%" #w "." #f "Lw", (int16)(v))
+#define lcd_fmt_hex2(v)     printf(LCD_FMT_SINK, "%02X", (BYTE)(v))
+#define lcd_fmt_hex4(v)     printf(LCD_FMT_SINK, "%04LX", (int16)(v))
+
+#else
+
+#ifndef LCD_FMT_PUTC
+#ifdef use_lcd_fb
+#define LCD_FMT_PUTC(c) lcd_fmt_fb_putc(c)
+
+#inline
+void lcd_fmt_fb_putc( char c) {
+   lcd_fb_store(lcd_fb_pos, c);
+   if (++lcd_fb_pos >= sizeof(lcd_fb))
+      lcd_fb_pos = 0;
+}
+#else
+#define LCD_FMT_PUTC(c) lcd_send_byte(1,c)
+#endif
+#endif
+
+BYTE const LCD_FMT_BCD[100] = {
+   0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,
+   0x10,0x11,0x12,0x13,0x14,0x15,0x16,0x17,0x18,0x19,
+   0x20,0x21,0x22,0x23,0x24,0x25,0x26,0x27,0x28,0x29,
+   0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37,0x38,0x39,
+   0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,0x48,0x49,
+   0x50,0x51,0x52,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+   0x60,0x61,0x62,0x63,0x64,0x65,0x66,0x67,0x68,0x69,
+   0x70,0x71,0x72,0x73,0x74,0x75,0x76,0x77,0x78,0x79,
+   0x80,0x81,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+   0x90,0x91,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99};
+
+char const LCD_FMT_HEX[] = "0123456789ABCDEF";
+
+BYTE lcd_fmt_d[5];                   // decimal digits, most significant first
+char lcd_fmt_sign;                   // 0, or ' '/'-' in front of the digits
+
+void lcd_fmt_split( int16 v) {
+   BYTE n;
+
+   n = 0;
+   while (v >= 10000) { v -= 10000; ++n; }
+   lcd_fmt_d[0] = n;
+   n = 0;
+   while (v >= 1000) { v -= 1000; ++n; }
+   lcd_fmt_d[1] = n;
+   n = 0;
+   while (v >= 100) { v -= 100; ++n; }
+   lcd_fmt_d[2] = n;
+   n = LCD_FMT_BCD[make8(v,0)];
+   lcd_fmt_d[3] = n >> 4;
+   lcd_fmt_d[4] = n & 0x0F;
+}
+
+void lcd_fmt_split8( BYTE v) {
+   BYTE n;
+
+   lcd_fmt_d[0] = 0;
+   lcd_fmt_d[1] = 0;
+   n = 0;
+   if (v >= 200)      { v -= 200; n = 2; }
+   else if (v >= 100) { v -= 100; n = 1; }
+   lcd_fmt_d[2] = n;
+   n = LCD_FMT_BCD[v];
+   lcd_fmt_d[3] = n >> 4;
+   lcd_fmt_d[4] = n & 0x0F;
+}
+
+void lcd_fmt_ssplit( signed int16 v) {
+   lcd_fmt_sign = ' ';
+   if (v < 0) {
+      lcd_fmt_sign = '-';
+      v = -v;                        // -32768 stays 0x8000, right as unsigned
+   }
+   lcd_fmt_split((int16)v);
+}
+
+// Shows lcd_fmt_d[first..4], with the decimal point before digit point
+// (5 for none).
+void lcd_fmt_emit( BYTE first, BYTE point) {
+   BYTE i;
+
+   for (i=0; i<first; ++i)
+      if (lcd_fmt_d[i]) {
+         for (i=first; i<5; ++i)
+            LCD_FMT_PUTC('*');
+         if (point < 5)
+            LCD_FMT_PUTC('*');
+         if (lcd_fmt_sign)
+            LCD_FMT_PUTC('*');
+         lcd_fmt_sign = 0;
+         return;
+      }
+   // blank leading zeros, keeping the units digit and a 0 before the point
+   for (i=first; i<4 && i+1<point && lcd_fmt_d[i]==0; ++i)
+      LCD_FMT_PUTC(' ');
+   if (lcd_fmt_sign) {
+      LCD_FMT_PUTC(lcd_fmt_sign);
+      lcd_fmt_sign = 0;
+   }
+   for (; i<5; ++i) {
+      if (i == point)
+         LCD_FMT_PUTC('.');
+      LCD_FMT_PUTC('0' + lcd_fmt_d[i]);
+   }
+}
+
+void lcd_fmt_hex2( BYTE v) {
+   LCD_FMT_PUTC(LCD_FMT_HEX[v >> 4]);
+   LCD_FMT_PUTC(LCD_FMT_HEX[v & 0x0F]);
+}
+
+#define lcd_fmt_u8(v)       { lcd_fmt_split8(v); lcd_fmt_emit(2, 5); }
+#define lcd_fmt_dec(v,w)    { lcd_fmt_split(v); lcd_fmt_emit(5-(w), 5); }
+#define lcd_fmt_sdec(v,w)   { lcd_fmt_ssplit(v); lcd_fmt_emit(6-(w), 5); }
+#define lcd_fmt_fix(v,w,f)  { lcd_fmt_split(v); lcd_fmt_emit(5-(w), 5-(f)); }
+#define lcd_fmt_hex4(v)     { lcd_fmt_hex2(make8(v,1)); lcd_fmt_hex2(make8(v,0)); }
+
+#endif
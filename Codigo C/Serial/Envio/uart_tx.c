@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////
+////                             UART_TX.C                              ////
+////          Interrupt driven UART transmit through a ring buffer      ////
+////                                                                    ////
+////  uart_tx_put(c)     Queues c and returns at once.  FALSE when the  ////
+////                     queue is full (c is not queued): try again     ////
+////                     later, the interrupt is making room.           ////
+////                                                                    ////
+////  uart_tx_write(p,n) Queues n bytes from p, all or none.  FALSE     ////
+////                     when fewer than n bytes are free.              ////
+////                                                                    ////
+////  uart_tx_free()     Bytes that can be queued now.                  ////
+////                                                                    ////
+////  uart_tx_idle()     TRUE once every queued byte left the pin.      ////
+////                                                                    ////
+////  uart_tx_full       Bytes refused because the queue was full.      ////
+////                                                                    ////
+////  The #int_TBE handler moves one byte to TXREG per interrupt and    ////
+////  disables itself when the queue is empty.  Include after           ////
+////  #use rs232 and do not mix with putc()/printf() on the same UART.  ////
+////                                                                    ////
+////  uart_tx_source(&c) can be defined before including to feed more   ////
+////  bytes once the queue is empty (frame.c does): TRUE with the next  ////
+////  byte in c, FALSE when there is nothing more to send.              ////
+////                                                                    ////
+////  uart_tx_refill() is called after each byte leaves the queue, to   ////
+////  queue more as room appears (usb_uart.c does).                     ////
+////                                                                    ////
+////  UART_TX_FLOW defined before including adds hardware flow control: ////
+////  RB2 is the CTS input, high while the receiver has no room (its    ////
+////  uart_rx.c RTS).  #int_TBE then stops before the next byte and the ////
+////  falling edge of RB2 (INT2) starts it again; the byte shifting out ////
+////  and the one in TXREG still go.  uart_tx_held counts the stops;    ////
+////  uart_tx_cts_on = FALSE ignores CTS (a peer without RTS, link.c).  ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE 32              // power of 2
+#endif
+
+#byte UART_TXREG = 0xFAD
+#bit  UART_TRMT  = 0xFAC.1           // TXSTA: shift register empty
+
+BYTE uart_tx_buf[UART_TX_SIZE];
+BYTE uart_tx_head;                   // next free entry, written by the senders
+BYTE uart_tx_tail;                   // next byte to send, written by the interrupt
+int16 uart_tx_full;
+
+#ifndef uart_tx_source
+#define uart_tx_source(c) FALSE
+#endif
+#ifndef uart_tx_refill
+#define uart_tx_refill()
+#endif
+
+#ifdef UART_TX_FLOW
+#bit  UART_CTS   = 0xF81.2           // PORTB: RB2/INT2, high to stop
+
+int16 uart_tx_held;
+int1 uart_tx_cts_on = TRUE;
+
+// CTS fell: the receiver has room again
+#int_EXT2
+void uart_tx_cts_isr(void) {
+   disable_interrupts(INT_EXT2);
+   enable_interrupts(INT_TBE);
+}
+
+// Stops #int_TBE until CTS falls
+void uart_tx_hold(void) {
+   disable_interrupts(INT_TBE);
+   if (uart_tx_held != 0xFFFF)
+      uart_tx_held++;
+   ext_int_edge(2, H_TO_L);
+   clear_interrupt(INT_EXT2);
+   enable_interrupts(INT_EXT2);
+   if (!UART_CTS)                    // fell before INT2 was armed
+      uart_tx_cts_isr();
+}
+#endif
+
+#int_TBE
+void uart_tx_isr(void) {
+   BYTE c;
+
+#ifdef UART_TX_FLOW
+   if (uart_tx_cts_on && UART_CTS) {
+      uart_tx_hold();
+      return;
+   }
+#endif
+   if (uart_tx_tail == uart_tx_head) {
+      if (uart_tx_source(&c))
+         UART_TXREG = c;
+      else
+         disable_interrupts(INT_TBE);
+      return;
+   }
+   UART_TXREG = uart_tx_buf[uart_tx_tail];
+   uart_tx_tail = (uart_tx_tail + 1) & (UART_TX_SIZE - 1);
+   uart_tx_refill();
+}
+
+BYTE uart_tx_free(void) {
+   return((uart_tx_tail - uart_tx_head - 1) & (UART_TX_SIZE - 1));
+}
+
+int1 uart_tx_put(BYTE c) {
+   BYTE next;
+
+   next = (uart_tx_head + 1) & (UART_TX_SIZE - 1);
+   if (next == uart_tx_tail) {
+      if (uart_tx_full != 0xFFFF)
+         uart_tx_full++;
+      return(FALSE);
+   }
+   uart_tx_buf[uart_tx_head] = c;
+   uart_tx_head = next;
+   enable_interrupts(INT_TBE);
+   return(TRUE);
+}
+
+int1 uart_tx_write(BYTE *p, BYTE n) {
+   if (uart_tx_free() < n) {
+      if (uart_tx_full != 0xFFFF)
+         uart_tx_full++;
+      return(FALSE);
+   }
+   while (n--) {
+      uart_tx_buf[uart_tx_head] = *p++;
+      uart_tx_head = (uart_tx_head + 1) & (UART_TX_SIZE - 1);
+   }
+   enable_interrupts(INT_TBE);
+   return(TRUE);
+}
+
+int1 uart_tx_idle(void) {
+   return(uart_tx_tail == uart_tx_head && UART_TRMT);
+}
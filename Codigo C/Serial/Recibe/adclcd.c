@@ -1,42 +1,106 @@
 #include "adclcd.h"
-int sre = 0; 
-//Variables para desplegar el dato recibido 
-#use rs232(baud=9600, xmit=pin_c6,rcv=pin_c7,parity=N)
+#use rs232(baud=UART_BAUD, xmit=pin_c6,rcv=pin_c7,parity=N)
 //Directiva para el uso del puerto serie 
+int1 SalidaTrama(BYTE *p);
+#define frame_rx_take(p) SalidaTrama(p) //las tramas de valores van al puerto D desde #int_RDA
+#ifdef use_flow
+#define UART_RX_FLOW //RB3 (RTS) en 1 con la cola de recepcion casi llena o una trama sin leer (antes de frame.c)
+#endif
+#include "frame.c" //tramas COBS con CRC-16, decodificadas en #int_RDA
+#ifdef use_bus9
+#define BUS_ADDR 1 //direccion de este nodo en el bus, distinta en cada Recibe
+#include "bus9.c" //el EUSART descarta las tramas de otros nodos (ADDEN)
+#endif
+#ifdef use_link
+#include "uart_tx.c" //las respuestas de la negociacion salen por #int_TBE
+#endif
+#include "uart_rx.c" //recepcion por #int_RDA, limpia OERR
 
 
 #build(reset=0x800)
 #build(interrupt=0x808)
 #org 0x0000, 0x07ff void bootloader() {}
 
+#define TAREA_SALIDA 0 //tareas del planificador (sched.c)
+#define SCHED_TASKS 1
+#include "sched.c"
+#ifdef use_autobaud
+#include "autobaud.c" //mide la velocidad de Envio, no hace falta reprogramar Recibe
+#endif
+#ifdef use_link
+#ifdef use_autobaud
+#define link_lost() abd_start() //Envio se reinicio: se mide otra vez su velocidad
+#endif
+#include "link.c" //responde a la negociacion que inicia Envio
+#endif
 
-#int_RDA 
-RDA_isr() //Vector de subrutina de servicio
-{ sre = getc ();
-//Guarda el valor del dato recibido 
-return sre;
-//Regresa el valor del dato recibido 
-} 
+
+#bit IDLEN = 0xFD3.7 //OSCCON: sleep() detiene solo el CPU, los perifericos siguen
+
+//Salida: despliega en el puerto D cada dato de la trama, en orden, en cuanto su CRC
+//resulta correcto dentro de #int_RDA; las tramas con CRC incorrecto se descartan
+//(frame_rx_crc_errors) y las de otros tipos quedan para TareaSalida
+int1 SalidaTrama(BYTE *p)
+{
+   BYTE i;
+
+   if (p[0] != FRAME_T_VALUE)
+      return(FALSE);
+   for (i = 0; i < p[1]; i++)
+      output_D(p[2 + i]); // Se pone en 1 el bit 7 del puerto D para el control de los displays
+   return(TRUE);
+}
+
+//Tarea salida: atiende las tramas de negociacion y descarta las de tipos que Recibe no usa
+void TareaSalida(void)
+{
+#ifdef use_autobaud
+   if (!abd_poll()) //tras link_lost(), hasta fijar otra vez la velocidad de Envio
+      return;
+#endif
+   if (frame_rx_ready()) {
+#ifdef use_link
+      if (frame_rx_type() == FRAME_T_LINK)
+         link_take(&frame_rx_data(0), frame_rx_len());
+#endif
+      frame_rx_done();
+   }
+#ifdef use_link
+   link_poll(); //plazos de la negociacion
+#endif
+}
 void main() 
 { 
 setup_adc_ports(NO_ANALOGS|VSS_VDD); 
 //setup_adc(ADC_OFF|ADC_TAD_MUL_0); 
 setup_psp(PSP_DISABLED); 
 setup_spi(FALSE); setup_wdt(WDT_OFF); 
-setup_timer_0(RTCC_INTERNAL); 
-setup_timer_1(T1_DISABLED); 
+sched_init(); //Timer0: tick de 1ms, Timer1: contador de ciclos
 setup_timer_2(T2_DISABLED,0,1); 
 setup_comparator(NC_NC_NC_NC); 
 setup_vref(FALSE); enable_interrupts(INT_RDA); enable_interrupts(GLOBAL); 
-setup_oscillator(OSC_8MHZ|OSC_TIMER1|OSC_31250|OSC_PLL_OFF); 
 
-set_uart_speed (9600); //Configura la velocidad de transferencia 
+uart_baud_setup(); //Configura la velocidad de transferencia (UART_BAUD, adclcd.h) 
+#ifdef use_bus9
+bus_setup(); //9 bits, solo las direcciones interrumpen
+#endif
 set_tris_d (0x00); //Configura el puerto D como salida 
-printf("Conexion Exitosa"); //Envia una cadena de caracteres para comprobar conexion 
+#ifdef use_flow
+set_tris_b (0xF7); //RB3 (RTS hacia Envio) como salida
+#endif
+#ifdef use_autobaud
+abd_start(); //la velocidad la da el primer 0x55 de Envio
+while (!abd_poll()) ;
+#endif
+#ifdef use_link
+link_init(); //parte de la velocidad de arranque; Envio inicia la negociacion
+#endif
+
+sched_every(TAREA_SALIDA, 0); //en cada pasada, la cola no debe llenarse 
 
+IDLEN = 1; //modo idle: el EUSART y los timers siguen con el CPU detenido
 while (1) { 
-   output_D(sre); // Se pone en 1 el bit 7 del puerto D para el control de los displays
-   delay_ms(25); //Retardo de 25 mS 
-  
+   SCHED_RUN(TAREA_SALIDA, TareaSalida());
+   sleep(); //hasta la siguiente interrupcion (byte recibido o tick de 1ms)
 } 
 }
@@ -3,7 +3,6 @@
 
 #FUSES NOWDT                 	//No Watch Dog Timer
 #FUSES WDT128                	//Watch Dog Timer uses 1:128 Postscale
-#FUSES HS                    	//High speed Osc (> 4mhz for PCM/PCH) (>10mhz for PCD)
 #FUSES NOPROTECT             	//Code not protected from reading
 #FUSES NOBROWNOUT            	//No brownout reset
 #FUSES BORV20                	//Brownout reset at 2.0V
@@ -25,11 +24,37 @@
 #FUSES MCLR                  	//Master Clear pin enabled
 #FUSES LPT1OSC               	//Timer1 configured for low-power operation
 #FUSES NOXINST               	//Extended set extension and Indexed Addressing mode disabled (Legacy mode)
-#FUSES PLL12                 	//Divide By 12(48MHz oscillator input)
-#FUSES CPUDIV4               	//System Clock by 4
+#FUSES PLL5                  	//Divide By 5(20MHz oscillator input)
 #FUSES USBDIV                	//USB clock source comes from PLL divide by 2
 #FUSES VREGEN                	//USB voltage regulator enabled
 #FUSES ICPRT                 	//ICPRT enabled
 
+//Perfil de reloj, cristal de 20MHz. Envio y Recibe deben usar el mismo
+//  RELOJ_48MHZ: PLL de 96MHz / 2, puerto serie de 115200 a 1000000 baud
+//  RELOJ_5MHZ:  el reloj original (HS / 4), hasta 115200 baud
+#define RELOJ_48MHZ
+
+#ifdef RELOJ_48MHZ
+#FUSES HSPLL                 	//High speed Osc with PLL
+#FUSES CPUDIV1               	//System Clock = 96MHz PLL / 2
+#use delay(clock=48000000)
+#else
+#FUSES HS                    	//High speed Osc (> 4mhz for PCM/PCH) (>10mhz for PCD)
+#FUSES CPUDIV4               	//System Clock by 4
 #use delay(crystal=20000000,  clock=5000000)
+#endif
+
+#define UART_BAUD 115200 //velocidad de arranque del enlace PIC-PIC, la que entiende cualquier version (la de Envio si use_autobaud)
+#define use_link //Envio y Recibe negocian velocidad, tamano de trama y control de flujo al arrancar (link.c)
+#define LINK_MAX_BAUD 1000000 //la velocidad mas alta que ofrece esta version en la negociacion
+#define use_autobaud //Recibe mide la velocidad de Envio con ABDEN (autobaud.c)
+//#define use_bus9 //bus multipunto: un Envio y varios Recibe, cada uno con su BUS_ADDR (bus9.c)
+//#define use_flow //RTS/CTS: RB3 de Recibe (cola de uart_rx.c casi llena) a RB2 de Envio, que espera
+#if defined(use_bus9) && defined(use_autobaud)
+#error use_autobaud necesita un solo Recibe, que responde por TX; quitelo para use_bus9
+#endif
+#if defined(use_bus9) && defined(use_link)
+#error use_link necesita un solo Recibe, que responde por TX; quitelo para use_bus9
+#endif
+#include "uart_baud.h" //calcula SPBRG para UART_BAUD, error de compilacion si no se alcanza
 
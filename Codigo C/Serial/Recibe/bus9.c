@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////
+////                              BUS9.C                                ////
+////        Addressed frames on a multidrop bus, 9 bit UART mode        ////
+////                                                                    ////
+////  One sender, many receivers on the same line (RS-485 or a TX       ////
+////  wire to every RX).  Each frame.c frame is preceded by an address  ////
+////  byte sent with the ninth bit set; the frame bytes have it clear.  ////
+////  The receivers keep ADDEN on, so their EUSART drops every byte     ////
+////  with the ninth bit clear without an interrupt: a node only sees   ////
+////  the address bytes, plus the frames sent to it.                    ////
+////                                                                    ////
+////  bus_setup()        Turns on 9 bit mode (and ADDEN on receivers).  ////
+////                     Call after uart_baud_setup().                  ////
+////                                                                    ////
+////  bus_send(a,t,p,n)  Like frame_send(), to the node with address a  ////
+////                     or to all of them with BUS_BROADCAST.  FALSE   ////
+////                     while the previous frame is still going out.   ////
+////                                                                    ////
+////  Receivers define BUS_ADDR (1 to 254, a different one per node)    ////
+////  before including; their frames come out of frame_rx_ready() as    ////
+////  usual.  bus_rx_others counts address bytes for other nodes, the   ////
+////  one interrupt each of their frames costs (stops at 0xFFFF).       ////
+////                                                                    ////
+////  Include after frame.c and before uart_tx.c and uart_rx.c.  The    ////
+////  nodes share the line, so they do not answer on it: no autobaud.c  ////
+////  handshake and no printf() on the bus.                             ////
+////////////////////////////////////////////////////////////////////////////
+
+#define BUS_BROADCAST 0xFF
+
+#bit BUS_TX9   = 0xFAC.6             // TXSTA: 9 bit transmission
+#bit BUS_TX9D  = 0xFAC.0             // TXSTA: ninth bit of the next byte
+#bit BUS_RX9   = 0xFAB.6             // RCSTA: 9 bit reception
+#bit BUS_ADDEN = 0xFAB.3             // RCSTA: take only bytes with the ninth bit set
+#bit BUS_RX9D  = 0xFAB.0             // RCSTA: ninth bit of the byte at the top of the FIFO
+
+BYTE bus_tx_addr;
+int1 bus_tx_addressed;               // the address byte of the frame went out
+
+int1 bus_send(BYTE a, BYTE type, BYTE *p, BYTE n) {
+   if (!frame_tx_idle())
+      return(FALSE);
+   bus_tx_addr = a;
+   bus_tx_addressed = FALSE;
+   return(frame_send(type, p, n));
+}
+
+// Next byte on the wire for #int_TBE, with TX9D set for it
+int1 bus_tx_byte(BYTE *c) {
+   if (!frame_tx_busy)
+      return(FALSE);
+   if (!bus_tx_addressed) {
+      bus_tx_addressed = TRUE;
+      BUS_TX9D = 1;
+      *c = bus_tx_addr;
+      return(TRUE);
+   }
+   BUS_TX9D = 0;
+   return(frame_tx_byte(c));
+}
+
+#undef  uart_tx_source
+#define uart_tx_source(c) bus_tx_byte(c)
+
+#ifdef BUS_ADDR
+#if BUS_ADDR < 1 || BUS_ADDR > 254
+#error BUS_ADDR must be 1 to 254
+#endif
+
+int1 bus_rx_9th;                     // ninth bit of the byte being read
+int16 bus_rx_others;
+
+// Takes one byte from #int_RDA, always TRUE
+int1 bus_rx_byte(BYTE c) {
+   if (bus_rx_9th) {                 // address: a frame cut short before it is bad
+      frame_rx_abort();
+      frame_rx_restart();
+      if (c == BUS_ADDR || c == BUS_BROADCAST) {
+         BUS_ADDEN = 0;              // ours, take its bytes
+      } else {
+         BUS_ADDEN = 1;
+         frame_count(bus_rx_others);
+      }
+      return(TRUE);
+   }
+   frame_rx_byte(c);
+   if (c == 0)
+      BUS_ADDEN = 1;                 // end of our frame, addresses only again
+   return(TRUE);
+}
+
+#undef  uart_rx_sink
+#define uart_rx_sink(c)  bus_rx_byte(c)
+#define uart_rx_peek()   bus_rx_9th = BUS_RX9D
+#endif
+
+void bus_setup(void) {
+   BUS_TX9D = 0;
+   BUS_TX9 = 1;
+#ifdef BUS_ADDR
+   BUS_RX9 = 1;
+   BUS_ADDEN = 1;
+#endif
+}
@@ -0,0 +1,261 @@
+////////////////////////////////////////////////////////////////////////////
+////                              FRAME.C                               ////
+////        Framed packets between the PICs: COBS, header, CRC-16       ////
+////                                                                    ////
+////  On the wire a frame is COBS(type, len, data[len], crc hi, crc lo) ////
+////  followed by a 0x00 delimiter.  The CRC is CRC-16-CCITT (0x1021,   ////
+////  start 0xFFFF) over type, len and data, from a table in ROM.       ////
+////  COBS keeps 0x00 out of the frame, so a receiver that lost bytes   ////
+////  resynchronizes on the next delimiter.                             ////
+////                                                                    ////
+////  frame_send(t,p,n)  Copies n bytes from p (n <= FRAME_MAX) as a    ////
+////                     frame of type t and returns at once.  FALSE    ////
+////                     while the previous frame is still going out.   ////
+////                                                                    ////
+////  frame_tx_idle()    TRUE when frame_send() would take a frame.     ////
+////                                                                    ////
+////  frame_rx_ready()   TRUE when a checked frame is waiting.  Read    ////
+////                     it with frame_rx_type(), frame_rx_len() and    ////
+////                     frame_rx_data(i), then call frame_rx_done().   ////
+////                                                                    ////
+////  frame_rx_take(p)   Optional hook, defined before including: gets  ////
+////                     each checked frame inside #int_RDA, p pointing ////
+////                     at type, len and data.  TRUE if it used the    ////
+////                     frame, which then does not wait for            ////
+////                     frame_rx_ready() nor counts as dropped.        ////
+////                                                                    ////
+////  frame_tx_byte(&c) and frame_rx_byte(c) encode and decode one byte ////
+////  at a time.  Including frame.c before uart_tx.c and uart_rx.c      ////
+////  hooks them into #int_TBE and #int_RDA, so COBS and the receive    ////
+////  CRC cost a few cycles per byte in the interrupts and the frame    ////
+////  being received does not wait for the main loop: one frame can be  ////
+////  waiting while the next one is decoded.  Do not queue raw bytes    ////
+////  with uart_tx_put() while frames are in use.                       ////
+////                                                                    ////
+////  Counters (stop at 0xFFFF):                                        ////
+////  frame_rx_crc_errors  Frames with a bad CRC.                       ////
+////  frame_rx_bad         Frames too long, too short (empty ones too:  ////
+////                       a 0x00 right after the delimiter), with a    ////
+////                       wrong len or cut by a UART error.            ////
+////  frame_rx_dropped     Good frames lost because the previous one    ////
+////                       was not read yet.  With UART_RX_FLOW defined ////
+////                       before including, RTS (uart_rx.c) is high    ////
+////                       while a frame waits for frame_rx_done(), so  ////
+////                       the sender stops instead; the couple of bytes////
+////                       already on the way cannot end a frame.       ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_MAX
+#define FRAME_MAX 64                 // data bytes per frame, up to 250
+#endif
+
+#define FRAME_BUF (FRAME_MAX + 4)    // type, len, data, crc
+
+// Frame types used between Envio and Recibe
+#define FRAME_T_VALUE 0x01           // data: values for PORTD, in order
+#define FRAME_T_LINK  0x02           // data: link negotiation (link.c)
+
+int16 const FRAME_CRC[256] = {
+   0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+   0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+   0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+   0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+   0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+   0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+   0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+   0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+   0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+   0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+   0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+   0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+   0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+   0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+   0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+   0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+   0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+   0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+   0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+   0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+   0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+   0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+   0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+   0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+   0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+   0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+   0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+   0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+   0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+   0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+   0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+   0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+#define frame_crc(crc,b) crc = (crc << 8) ^ FRAME_CRC[make8(crc,1) ^ (b)]
+#define frame_count(n)   if (n != 0xFFFF) n++
+
+BYTE frame_tx_buf[FRAME_BUF];
+BYTE frame_tx_n;                     // bytes in frame_tx_buf
+BYTE frame_tx_pos;                   // next byte of frame_tx_buf to encode
+BYTE frame_tx_left;                  // bytes left in the current COBS block
+int1 frame_tx_zero;                  // the current block ends at a 0x00
+int1 frame_tx_busy;
+int16 frame_tx_frames;
+
+#define frame_tx_idle() (!frame_tx_busy)
+
+int1 frame_send(BYTE type, BYTE *p, BYTE n) {
+   int16 crc;
+   BYTE i, c;
+
+   if (frame_tx_busy || n > FRAME_MAX)
+      return(FALSE);
+   crc = 0xFFFF;
+   frame_tx_buf[0] = type;
+   frame_crc(crc, type);
+   frame_tx_buf[1] = n;
+   frame_crc(crc, n);
+   for (i = 0; i < n; i++) {
+      c = p[i];
+      frame_tx_buf[2 + i] = c;
+      frame_crc(crc, c);
+   }
+   frame_tx_buf[2 + n] = make8(crc, 1);
+   frame_tx_buf[3 + n] = make8(crc, 0);
+   frame_tx_n = n + 4;
+   frame_tx_pos = 0;
+   frame_tx_left = 0;
+   frame_tx_busy = TRUE;
+   frame_count(frame_tx_frames);
+   enable_interrupts(INT_TBE);
+   return(TRUE);
+}
+
+// Next byte on the wire, FALSE when there is no frame to send.  The data
+// ends with an implicit 0x00 that only closes the last block.
+int1 frame_tx_byte(BYTE *c) {
+   BYTE k;
+
+   if (!frame_tx_busy)
+      return(FALSE);
+   if (frame_tx_left) {
+      *c = frame_tx_buf[frame_tx_pos++];
+      if (--frame_tx_left == 0 && frame_tx_zero)
+         frame_tx_pos++;
+      return(TRUE);
+   }
+   if (frame_tx_pos > frame_tx_n) {  // past the implicit 0x00
+      *c = 0;
+      frame_tx_busy = FALSE;
+      return(TRUE);
+   }
+   k = 0;
+   while (k < 254 && frame_tx_pos + k < frame_tx_n && frame_tx_buf[frame_tx_pos + k])
+      k++;
+   *c = k + 1;
+   frame_tx_left = k;
+   frame_tx_zero = (k < 254);
+   if (k == 0)
+      frame_tx_pos++;
+   return(TRUE);
+}
+
+BYTE frame_rx_buf[2][FRAME_BUF];     // one being decoded, one for the reader
+BYTE frame_rx_w;                     // buffer being decoded
+BYTE frame_rx_r;                     // buffer of the waiting frame
+int1 frame_rx_avail;
+BYTE frame_rx_n;                     // bytes decoded into frame_rx_buf[frame_rx_w]
+BYTE frame_rx_left;                  // bytes left in the current COBS block
+int1 frame_rx_zero;                  // the current block ends at a 0x00
+int1 frame_rx_skip;                  // frame already bad, wait for the delimiter
+int16 frame_rx_crc = 0xFFFF;
+int16 frame_rx_crc_errors;
+int16 frame_rx_bad;
+int16 frame_rx_dropped;
+int16 frame_rx_frames;
+
+#define frame_rx_ready()  frame_rx_avail
+#define frame_rx_type()   frame_rx_buf[frame_rx_r][0]
+#define frame_rx_len()    frame_rx_buf[frame_rx_r][1]
+#define frame_rx_data(i)  frame_rx_buf[frame_rx_r][2 + (i)]
+#ifdef UART_RX_FLOW
+#define uart_rx_hold()    frame_rx_avail
+void uart_rx_resume(void);           // uart_rx.c
+
+void frame_rx_done(void) {
+   frame_rx_avail = FALSE;
+   uart_rx_resume();                 // RTS low, the sender goes on
+}
+#else
+#define frame_rx_done()   frame_rx_avail = FALSE
+#endif
+
+#ifndef frame_rx_take
+#define frame_rx_take(p)  FALSE
+#endif
+
+void frame_rx_restart(void) {
+   frame_rx_n = 0;
+   frame_rx_left = 0;
+   frame_rx_zero = FALSE;
+   frame_rx_skip = FALSE;
+   frame_rx_crc = 0xFFFF;
+}
+
+// A byte of the current frame was lost (UART framing error or overrun)
+void frame_rx_abort(void) {
+   if (frame_rx_n || frame_rx_left)
+      frame_count(frame_rx_bad);
+   frame_rx_restart();
+   frame_rx_skip = TRUE;
+}
+
+void frame_rx_put(BYTE c) {
+   if (frame_rx_n == FRAME_BUF) {
+      frame_count(frame_rx_bad);
+      frame_rx_skip = TRUE;
+      return;
+   }
+   frame_rx_buf[frame_rx_w][frame_rx_n++] = c;
+   frame_crc(frame_rx_crc, c);
+}
+
+// Takes one byte from the wire, always TRUE (the byte is consumed)
+int1 frame_rx_byte(BYTE c) {
+   if (c == 0) {                     // delimiter
+      if (frame_rx_skip) {
+         frame_rx_restart();
+      } else if (frame_rx_left || frame_rx_n < 4 ||
+                 frame_rx_buf[frame_rx_w][1] != frame_rx_n - 4) {
+         frame_count(frame_rx_bad);  // empty too: frame_send() never sends two 0x00 in a row
+      } else if (frame_rx_crc != 0) {  // CRC over data and CRC is 0
+         frame_count(frame_rx_crc_errors);
+      } else if (frame_rx_take(frame_rx_buf[frame_rx_w])) {
+         frame_count(frame_rx_frames);
+      } else if (frame_rx_avail) {
+         frame_count(frame_rx_dropped);
+      } else {
+         frame_rx_r = frame_rx_w;
+         frame_rx_w ^= 1;
+         frame_rx_avail = TRUE;
+         frame_count(frame_rx_frames);
+      }
+      frame_rx_restart();
+      return(TRUE);
+   }
+   if (frame_rx_skip)
+      return(TRUE);
+   if (frame_rx_left) {
+      frame_rx_put(c);
+      frame_rx_left--;
+      return(TRUE);
+   }
+   if (frame_rx_zero)                // the previous block ended at a 0x00
+      frame_rx_put(0);
+   frame_rx_left = c - 1;
+   frame_rx_zero = (c != 0xFF);
+   return(TRUE);
+}
+
+#define uart_tx_source(c) frame_tx_byte(c)
+#define uart_rx_sink(c)   frame_rx_byte(c)
+#define uart_rx_error()   frame_rx_abort()
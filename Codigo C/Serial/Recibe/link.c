@@ -0,0 +1,379 @@
+////////////////////////////////////////////////////////////////////////////
+////                               LINK.C                               ////
+////       Capability handshake at link start, then the best common     ////
+////       settings                                                     ////
+////                                                                    ////
+////  Both sides start at the base rate (UART_BAUD, or what autobaud.c  ////
+////  measured).  The initiator sends its capabilities in a             ////
+////  FRAME_T_LINK frame: version, a mask of the LINK_RATES its clock   ////
+////  makes within UART_BAUD_MAX_ERROR up to LINK_MAX_BAUD, FRAME_MAX   ////
+////  and LINK_F_* flags.  The responder answers with its own, both     ////
+////  take the fastest common rate, the smaller frame size and the      ////
+////  flags both have, and switch once their TX is empty.  The          ////
+////  initiator then sends LINK_OK at the new rate until the responder  ////
+////  echoes it; CAPS and LINK_OK are tried LINK_TRIES times each, and  ////
+////  then both go back to the base rate.  A peer whose firmware        ////
+////  predates this never answers and keeps the base settings, so new   ////
+////  rates and features can be rolled out one node at a time.          ////
+////                                                                    ////
+////  Once up at a faster rate the responder watches the line: with     ////
+////  LINK_ERRORS framing, length or CRC errors (uart_rx.c, frame.c)    ////
+////  within LINK_TIMEOUT ms and no good frame among them, the          ////
+////  initiator is taken to be back at the base rate (it was reset),    ////
+////  and the responder falls back too and calls link_lost().  The      ////
+////  initiator's next CAPS then gets its answer.  The initiator does   ////
+////  not read the line once up: a responder that resets stays out of   ////
+////  reach until the initiator resets too.                             ////
+////                                                                    ////
+////  link_init()        Saves the base rate.  Call after               ////
+////                     uart_baud_setup() (and abd_poll() or           ////
+////                     abd_sync_poll()), before link_poll().          ////
+////                                                                    ////
+////  link_poll()        Call often.  TRUE while no negotiation is      ////
+////                     under way; the initiator's first calls start   ////
+////                     it, so send nothing else until it returns      ////
+////                     TRUE.                                          ////
+////                                                                    ////
+////  link_take(p,n)     Hands over the data of a FRAME_T_LINK frame.   ////
+////                     Without uart_rx.c (the initiator)              ////
+////                     link_poll() reads the UART and does it.        ////
+////                                                                    ////
+////  link_lost()        Optional hook, defined before including:       ////
+////                     called on the responder when it falls back     ////
+////                     from a link that was up.  Recibe with          ////
+////                     autobaud.c measures the rate again from it;    ////
+////                     the rate a CAPS then comes at is the new base. ////
+////                                                                    ////
+////  link_baud          Rate in use, bit/s.                            ////
+////  link_frame_max     Largest frame both sides take.                 ////
+////  link_flags         LINK_F_* both sides have.                      ////
+////  link_fallbacks     Negotiations that ended at the base rate       ////
+////                     (no answer, or no LINK_OK at the new rate),    ////
+////                     and links that were up and went back to it.    ////
+////  link_peer_lock_ms  Initiator: the time the responder's            ////
+////                     autobaud.c took to lock (abd_lock_us()), in    ////
+////                     ms, from its CAPS; 0xFFFF if it did not say.   ////
+////                                                                    ////
+////  Define LINK_INITIATOR before including on the side that starts    ////
+////  (Envio).  Include after frame.c, uart_baud.h, uart_tx.c (both     ////
+////  sides send frames), sched.c and autobaud.c if used.  Not for the  ////
+////  bus9.c bus, where the nodes do not answer.                        ////
+////////////////////////////////////////////////////////////////////////////
+
+#define LINK_VERSION 1
+
+#define LINK_CAPS    1               // data: op, version, rates, frame max, flags[, lock ms hi, lo]
+#define LINK_OK      2               // data: op
+
+#define LINK_F_CRC   0x01            // frames checked with CRC-16 (frame.c, always)
+#define LINK_F_FLOW  0x02            // RTS/CTS wired and on (UART_TX_FLOW, UART_RX_FLOW)
+
+#ifndef LINK_MAX_BAUD
+#define LINK_MAX_BAUD 1000000
+#endif
+#ifndef LINK_TIMEOUT
+#define LINK_TIMEOUT 20              // ms to wait for each answer
+#endif
+#ifndef LINK_TRIES
+#define LINK_TRIES   3
+#endif
+#define LINK_SETTLE  2               // ms for the peer to switch too
+#ifndef LINK_ERRORS
+#define LINK_ERRORS  4               // errors in LINK_TIMEOUT ms that end a link that was up
+#endif
+
+#ifndef link_lost
+#define link_lost()
+#endif
+
+#if defined(UART_TX_FLOW) || defined(UART_RX_FLOW)
+#define LINK_FLAGS   (LINK_F_CRC | LINK_F_FLOW)
+#else
+#define LINK_FLAGS   LINK_F_CRC
+#endif
+
+int32 const LINK_RATES[8] = {9600, 19200, 38400, 57600, 115200, 250000, 500000, 1000000};
+
+#define LINK_BASE    0               // at the base rate, nothing under way
+#define LINK_START   1               // initiator: CAPS to send
+#define LINK_CAPS_WAIT 2             // initiator: CAPS sent, waiting for the answer
+#define LINK_SWITCH  3               // agreed, switch once the TX is empty
+#define LINK_SETTLING 4              // initiator: switched, LINK_OK after LINK_SETTLE
+#define LINK_CONFIRM 5               // switched, waiting for LINK_OK
+#define LINK_UP      6               // at the agreed settings
+
+#bit  LINK_RCIF  = 0xF9E.5
+#bit  LINK_OERR  = 0xFAB.1
+#bit  LINK_FERR  = 0xFAB.2
+#bit  LINK_CREN  = 0xFAB.4
+#byte LINK_RCREG = 0xFAE
+
+BYTE link_state;
+BYTE link_rate;                      // agreed LINK_RATES index, 0xFF: the base rate
+BYTE link_tries;
+int16 link_deadline;
+int16 link_base_brg;
+int32 link_baud;
+BYTE link_frame_max;
+BYTE link_flags;
+int16 link_fallbacks;
+int16 link_peer_lock_ms;
+#ifndef LINK_INITIATOR
+int16 link_err_mark;                 // link_errors() when the window started
+int16 link_good_mark;                // frame_rx_frames then
+
+#define link_errors() (uart_rx_framing + frame_rx_bad + frame_rx_crc_errors)
+#endif
+
+// SPBRGH:SPBRG for a rate, BRG16 = BRGH = 1 as uart_baud.h sets them
+int16 link_brg(int32 baud) {
+   return((getenv("CLOCK") + 2 * baud) / (4 * baud) - 1);
+}
+
+int32 link_actual(int16 brg) {
+   return(getenv("CLOCK") / (4 * ((int32)brg + 1)));
+}
+
+// LINK_RATES this side makes within UART_BAUD_MAX_ERROR, up to LINK_MAX_BAUD
+BYTE link_rates(void) {
+   BYTE i, m;
+   int32 b, a, e;
+
+   m = 0;
+   for (i = 0; i < 8; i++) {
+      b = LINK_RATES[i];
+      if (b > LINK_MAX_BAUD)
+         continue;
+      a = link_actual(link_brg(b));
+      e = (a > b) ? a - b : b - a;
+      if (e * 1000 / b <= UART_BAUD_MAX_ERROR)
+         m |= 1 << i;
+   }
+   return(m);
+}
+
+void link_set_brg(int16 brg) {
+   UART_SPBRGH = make8(brg, 1);
+   UART_SPBRG = make8(brg, 0);       // writing SPBRG restarts the generator
+   link_baud = link_actual(brg);
+}
+
+void link_base(void) {
+   link_set_brg(link_base_brg);
+   link_rate = 0xFF;
+   link_frame_max = FRAME_MAX;
+   link_flags = 0;                   // the peer may not drive RTS
+#ifdef UART_TX_FLOW
+   uart_tx_cts_on = FALSE;
+#endif
+   link_state = LINK_BASE;
+}
+
+void link_fallback(void) {
+   if (link_fallbacks != 0xFFFF)
+      link_fallbacks++;
+   link_base();
+}
+
+void link_send_caps(void) {
+   BYTE p[7];
+#if defined(ABD_SYNC) && !defined(LINK_INITIATOR)
+   int32 ms;
+#endif
+
+   p[0] = LINK_CAPS;
+   p[1] = LINK_VERSION;
+   p[2] = link_rates();
+   p[3] = FRAME_MAX;
+   p[4] = LINK_FLAGS;
+#if defined(ABD_SYNC) && !defined(LINK_INITIATOR)
+   ms = abd_lock_us() / 1000;        // time autobaud.c took to lock on the initiator's rate
+   if (ms > 0xFFFE)
+      ms = 0xFFFE;
+   p[5] = make8(ms, 1);
+   p[6] = make8(ms, 0);
+   frame_send(FRAME_T_LINK, p, 7);
+#else
+   frame_send(FRAME_T_LINK, p, 5);
+#endif
+}
+
+void link_send_ok(void) {
+   BYTE op;
+
+   op = LINK_OK;
+   frame_send(FRAME_T_LINK, &op, 1);
+}
+
+// Best common settings from the peer's CAPS
+void link_agree(BYTE *p) {
+   BYTE m, i;
+
+   m = link_rates() & p[2];
+   link_rate = 0xFF;
+   for (i = 0; i < 8; i++)
+      if (m & (1 << i))
+         link_rate = i;
+   link_frame_max = (p[3] < FRAME_MAX) ? p[3] : FRAME_MAX;
+   link_flags = LINK_FLAGS & p[4];
+#ifdef UART_TX_FLOW
+   uart_tx_cts_on = (link_flags & LINK_F_FLOW) != 0;
+#endif
+   link_state = LINK_SWITCH;
+}
+
+#ifndef LINK_INITIATOR
+// Up: a new error window from now
+void link_watch(void) {
+   link_err_mark = link_errors();
+   link_good_mark = frame_rx_frames;
+   link_deadline = sched_now() + LINK_TIMEOUT;
+}
+
+// Up: TRUE when LINK_ERRORS errors came in this window and no good frame
+int1 link_dead(void) {
+   if (link_good_mark != frame_rx_frames ||
+       (signed int16)(sched_now() - link_deadline) >= 0) {
+      link_watch();
+      return(FALSE);
+   }
+   return((int16)(link_errors() - link_err_mark) >= LINK_ERRORS);
+}
+#endif
+
+void link_take(BYTE *p, BYTE n) {
+   if (n < 1)
+      return;
+   if (p[0] == LINK_CAPS) {
+      if (n < 5 || p[1] < 1)
+         return;
+#ifdef LINK_INITIATOR
+      if (link_state == LINK_CAPS_WAIT) {
+         link_peer_lock_ms = (n >= 7) ? make16(p[5], p[6]) : 0xFFFF;
+         link_agree(p);
+      }
+#else
+      if (!frame_tx_idle())
+         return;                     // the initiator asks again
+      // it came at the initiator's base rate, which autobaud.c may have
+      // measured again since link_init()
+      link_base_brg = make16(UART_SPBRGH, UART_SPBRG);
+      link_set_brg(link_base_brg);
+      link_send_caps();
+      link_agree(p);
+#endif
+      return;
+   }
+   if (p[0] == LINK_OK) {
+#ifdef LINK_INITIATOR
+      if (link_state == LINK_CONFIRM)
+         link_state = LINK_UP;
+#else
+      if (link_state == LINK_CONFIRM) {
+         link_send_ok();
+         link_watch();
+         link_state = LINK_UP;
+      } else if (link_state == LINK_UP) {
+         link_send_ok();             // the initiator lost the first one
+      }
+#endif
+   }
+}
+
+#ifndef UART_RX_SIZE
+// No uart_rx.c: frames are read from the UART here while negotiating
+void link_rx_poll(void) {
+   BYTE c;
+   int1 ferr;
+
+   if (LINK_OERR) {
+      LINK_CREN = 0;
+      LINK_CREN = 1;
+      frame_rx_abort();
+   }
+   while (LINK_RCIF) {
+      ferr = LINK_FERR;              // belongs to the byte about to be read
+      c = LINK_RCREG;
+      if (ferr)
+         frame_rx_abort();
+      else
+         frame_rx_byte(c);
+   }
+   if (frame_rx_ready()) {
+      if (frame_rx_type() == FRAME_T_LINK)
+         link_take(&frame_rx_data(0), frame_rx_len());
+      frame_rx_done();
+   }
+}
+#endif
+
+void link_init(void) {
+   link_base_brg = make16(UART_SPBRGH, UART_SPBRG);
+   link_fallbacks = 0;
+   link_peer_lock_ms = 0xFFFF;
+   link_tries = 0;
+   link_base();
+#ifdef LINK_INITIATOR
+   link_state = LINK_START;
+#endif
+}
+
+int1 link_poll(void) {
+   switch (link_state) {
+   case LINK_UP:
+#ifndef LINK_INITIATOR
+      if (link_rate != 0xFF && link_dead()) {
+         link_fallback();            // the initiator went back to the base rate
+         link_lost();
+      }
+#endif
+      // fall through
+   case LINK_BASE:
+      return(TRUE);
+   case LINK_START:
+      if (!frame_tx_idle())
+         return(FALSE);
+      link_send_caps();
+      link_tries++;
+      link_deadline = sched_now() + LINK_TIMEOUT;
+      link_state = LINK_CAPS_WAIT;
+      return(FALSE);
+   case LINK_SWITCH:
+      if (!frame_tx_idle() || !uart_tx_idle())
+         return(FALSE);
+      if (link_rate != 0xFF)
+         link_set_brg(link_brg(LINK_RATES[link_rate]));
+      link_tries = 0;
+#ifdef LINK_INITIATOR
+      link_deadline = sched_now() + LINK_SETTLE;
+      link_state = LINK_SETTLING;
+#else
+      link_deadline = sched_now() + LINK_TIMEOUT * LINK_TRIES + LINK_SETTLE;
+      link_state = LINK_CONFIRM;
+#endif
+      return(FALSE);
+   case LINK_SETTLING:
+      if ((signed int16)(sched_now() - link_deadline) < 0 || !frame_tx_idle())
+         return(FALSE);
+      link_send_ok();
+      link_tries++;
+      link_deadline = sched_now() + LINK_TIMEOUT;
+      link_state = LINK_CONFIRM;
+      return(FALSE);
+   }
+#ifndef UART_RX_SIZE
+   link_rx_poll();
+   if (link_state != LINK_CAPS_WAIT && link_state != LINK_CONFIRM)
+      return(link_state == LINK_UP);
+#endif
+   if ((signed int16)(sched_now() - link_deadline) < 0)
+      return(FALSE);
+#ifdef LINK_INITIATOR
+   if (link_tries < LINK_TRIES) {    // ask again, the deadline is past already
+      link_state = (link_state == LINK_CONFIRM) ? LINK_SETTLING : LINK_START;
+      return(FALSE);
+   }
+#endif
+   link_fallback();
+   return(TRUE);
+}
@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////
+////                            UART_BAUD.H                             ////
+////       EUSART baud rate generator settings computed at compile      ////
+////       time from the clock given in #use delay                      ////
+////                                                                    ////
+////  UART_BAUD           Wanted rate, define before including          ////
+////                      (default 9600).  Use it in #use rs232 too.    ////
+////                                                                    ////
+////  UART_BAUD_MAX_ERROR Largest error allowed in 1/1000 (default 20,  ////
+////                      2%).  A rate that cannot be made closer       ////
+////                      than that at this clock stops the build.      ////
+////                                                                    ////
+////  uart_baud_setup()   Loads SPBRGH:SPBRG, BRG16 and BRGH.  Call     ////
+////                      instead of set_uart_speed(), after the        ////
+////                      oscillator is running at its final speed.     ////
+////                                                                    ////
+////  UART_BRG, UART_BAUD_ACTUAL and UART_BAUD_ERROR give the divisor,  ////
+////  the rate really produced and its error in 1/1000.                 ////
+////                                                                    ////
+////  The generator always runs with BRG16 = 1 and BRGH = 1, dividing   ////
+////  Fosc by 4 * (UART_BRG + 1): the finest steps the EUSART has, so   ////
+////  the smallest error at any rate.  At 48MHz this gives 115200 with  ////
+////  0.16% error and 1000000 exactly.                                  ////
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef UART_BAUD
+#define UART_BAUD 9600
+#endif
+
+#ifndef UART_BAUD_MAX_ERROR
+#define UART_BAUD_MAX_ERROR 20
+#endif
+
+#define UART_BRG16 1
+#define UART_BRGH  1
+#define UART_BRG   ((getenv("CLOCK") + 2 * UART_BAUD) / (4 * UART_BAUD) - 1)   // rounded
+
+#if UART_BRG < 0
+#error UART_BAUD faster than Fosc/4
+#endif
+#if UART_BRG > 65535
+#error UART_BAUD too slow for the baud rate generator at this clock
+#endif
+
+#define UART_BAUD_ACTUAL (getenv("CLOCK") / (4 * (UART_BRG + 1)))
+
+#if UART_BAUD_ACTUAL > UART_BAUD
+#define UART_BAUD_ERROR  ((UART_BAUD_ACTUAL - UART_BAUD) * 1000 / UART_BAUD)
+#else
+#define UART_BAUD_ERROR  ((UART_BAUD - UART_BAUD_ACTUAL) * 1000 / UART_BAUD)
+#endif
+
+#if UART_BAUD_ERROR > UART_BAUD_MAX_ERROR
+#error UART_BAUD error over UART_BAUD_MAX_ERROR at this clock, change the rate or the clock
+#endif
+
+#byte UART_SPBRG  = 0xFAF
+#byte UART_SPBRGH = 0xFB0
+#bit  UART_BRG16_BIT = 0xFB8.3       // BAUDCON
+#bit  UART_BRGH_BIT  = 0xFAC.2       // TXSTA
+
+void uart_baud_setup(void) {
+   UART_BRG16_BIT = UART_BRG16;
+   UART_BRGH_BIT = UART_BRGH;
+   UART_SPBRGH = UART_BRG >> 8;
+   UART_SPBRG = UART_BRG & 0xFF;     // writing SPBRG restarts the generator
+}